@@ -4,18 +4,46 @@
 #include <istream>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <stack>
 #include <vector>
 #include <map>
+#include <functional>
 #include <memory>
+#include <memory_resource>
+#include <optional>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <shared_mutex>
+#include <mutex>
+#include <exception>
+#include <chrono>
+#include <stdexcept>
 
 // temporary so vs code isnt a pain about it
+#if !defined(SJSON_OBJECT) && !defined(SJSON_BENCH)
 #define SJSON_OBJECT
 #define SJSON_TEST
+#endif
 
 // Set this to zero to treat json with trailing commas as invalid.
 #define JSON_ALLOW_TRAILING_COMMA true
 
+// SIMD tokenizing is compiled per function with target attributes and picked
+// at runtime, so no -mavx2 is needed. Other platforms use the scalar path.
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SJSON_X86_SIMD
+#endif
+
+// Define SJSON_STATS to be able to collect ParseStats. Without it the
+// counting code isn't compiled at all.
+
+// Files are loaded with mmap where there is one, and read into memory elsewhere.
+#if defined(__unix__) || defined(__APPLE__)
+#define SJSON_MMAP
+#endif
+
 namespace sjson
 {
 
@@ -26,13 +54,17 @@ namespace sjson
         STRING, INTEGER, REAL, ARRAY, OBJECT,
     } NodeType;
 
+    class ObjectMap;
+
     class Node {
         public:
 
             //idea: byte type for better msgpk compat
             typedef std::string string;
-            typedef std::map<string, Node> object;
-            typedef std::vector<Node> array;
+            // Collections take a memory resource so a Document can put a whole
+            // tree in its arena. Copies always land on the default (heap) resource.
+            typedef ObjectMap object;
+            typedef std::pmr::vector<Node> array;
             typedef double real;
             typedef long int integer;
 
@@ -42,28 +74,43 @@ namespace sjson
             //todo: messagepack
 
             Node& operator=(const Node&);
+            Node& operator=(Node&&) noexcept;
 
             // todo: own comparison operators
             Node();
             Node(const string&);
+            Node(string&&);
             Node(const real&);
             Node(const integer&);
             Node(const array&);
+            Node(array&&);
             Node(const object&);
+            Node(object&&);
             // do some template shit for arrays and objects
 
             // need these since we have heap allocated data to worry about
             Node(const Node&);
+            // moves steal the payload and leave the source as null
+            Node(Node&&) noexcept;
             ~Node();
 
             NodeType get_type() const;
             void set_type(const NodeType&);
 
+            // A string node that points at bytes it does not own. The caller
+            // keeps them alive; copying the node makes an owned string.
+            static Node borrow_string(std::string_view);
+
             //string
             string as_string() const;
+            // works for owned and borrowed strings, throws wrong_type otherwise
+            std::string_view as_string_view() const;
+            // a borrowed string is turned into an owned one first
             string& as_string_mut();
+            // throws wrong_type for borrowed strings, they have no std::string
             const string& as_string_reference() const;
-            void set_string(string);
+            void set_string(const string&);
+            void set_string(string&&);
 
             //Number
             real as_real() const;
@@ -79,143 +126,225 @@ namespace sjson
             const array as_array() const;
             array& as_array_mut();
             const array& as_array_reference() const;
-            void set_array(std::vector<Node>);
+            void set_array(const array&);
+            void set_array(array&&);
 
             const object as_object() const;
             object& as_object_mut();
             const object& as_object_reference() const;
             void set_object(const object&);
-            
+            void set_object(object&&);
+
+            // Heap bytes held by this node and everything under it, by
+            // capacity, not counting sizeof(Node) for this node itself.
+            // Borrowed strings and interned keys belong to someone else and
+            // count nothing. Walks the whole tree.
+            std::size_t memory_usage() const;
+
         private:
-            static string _array_to_string(array o);
-            static string _object_to_string(object o);
+            static string _array_to_string(const array& o);
+            static string _object_to_string(const object& o);
 
             std::string _to_string() const;
 
             void _destroy_variant();
 
             void _copy_variant(const Node&);
+            void _move_variant(Node&) noexcept;
 
+            // Tagged storage. Scalars live inline, strings use the inline
+            // std::string (short strings stay in its small buffer), and
+            // collections are held by pointer so the node stays small.
+            // Collections are allocated from their own memory resource.
             NodeType base_type = NONE;
-            bool number_is_integer = false;
-
-            // in progress: better way of doing this than using union
-            class MultiTypeBase {
-                public:
-                    // needed for frees
-                    virtual ~MultiTypeBase();
-                    virtual NodeType get_type() const = 0;
-
-                    virtual real as_real() const;
-                    virtual real& as_real_mut();
-                    
-                    virtual integer as_int() const;
-                    virtual integer& as_int_mut();
-
-                    virtual string as_string() const;
-                    virtual string& as_string_mut();
-                    virtual const string& as_string_reference();
-
-                    virtual array as_array() const;
-                    virtual array& as_array_mut();
-                    virtual const array& as_array_reference() const;
-
-                    virtual object as_object() const;
-                    virtual object& as_object_mut();
-                    virtual const object& as_object_reference() const;
-
-            };
-
-            //todo
-            MultiTypeBase* variant = nullptr;
-
-            class Mnull : public MultiTypeBase {
-                public:
-                    NodeType get_type() const override;
-                    real as_real() const override;
-                    integer as_int() const override;
+            // STRING only: view_value is active instead of string_value
+            bool string_borrowed = false;
+
+            union {
+                integer int_value;
+                real real_value;
+                string string_value;
+                std::string_view view_value;
+                array* array_value;
+                object* object_value;
             };
 
-            class MInt : public MultiTypeBase {
-                public:
-                    MInt(const integer& value);
+    };
 
-                    NodeType get_type() const override;
-                    integer as_int() const override;
-                    integer& as_int_mut() override;
+    // hash used for every object key, by ObjectMap and KeyTable alike
+    inline uint32_t hash_key_text(std::string_view text) {
+        return static_cast<uint32_t>(std::hash<std::string_view>()(text));
+    }
 
-                    real as_real() const override;
+    // An object key: a view of the key's text plus its hash. Keys interned
+    // in a KeyTable point into the table and usually compare by pointer.
+    // Any other key only views its text, an ObjectMap copies the bytes in
+    // when it stores one. Converts implicitly from anything string like,
+    // so lookups with a plain string still work.
+    class Key {
+        public:
+            static constexpr std::size_t MAX_LENGTH = 0x7fffffff;
 
-                    string as_string() const override;
-                    array as_array() const override;
+            Key() : length(0), interned(false) {}
 
-                private:
-                    integer value;
+            template <typename Text, typename = typename std::enable_if<std::is_convertible<const Text&, std::string_view>::value>::type>
+            Key(const Text& text) : Key(std::string_view(text), false) {}
 
-            };
+            std::string_view view() const { return std::string_view(text, length); }
+            operator std::string_view() const { return view(); }
+            const char* data() const { return text; }
+            std::size_t size() const { return length; }
+            uint32_t hash() const { return hash_value; }
+            bool is_interned() const { return interned; }
 
-            class MReal : public MultiTypeBase {
-                public:
-                    MReal(const real& value);
+            friend bool operator==(const Key& a, const Key& b) {
+                return a.hash_value == b.hash_value && a.length == b.length
+                    && (a.text == b.text || std::memcmp(a.text, b.text, a.length) == 0);
+            }
+            friend bool operator!=(const Key& a, const Key& b) {
+                return !(a == b);
+            }
 
-                    NodeType get_type() const override;
-                    real as_real() const override;
-                    real& as_real_mut() override;
+        private:
+            friend class KeyTable;
+            friend class ObjectMap;
+
+            // the length field is 31 bits, longer keys throw std::length_error
+            Key(std::string_view t, bool is_interned)
+                : text(t.data()), length(checked_length(t)), interned(is_interned),
+                  hash_value(hash_key_text(t)) {}
+            Key(const char* t, uint32_t l, bool is_interned, uint32_t h)
+                : text(t), length(l), interned(is_interned), hash_value(h) {}
+
+            static uint32_t checked_length(std::string_view t) {
+                if (t.size() > MAX_LENGTH) throw std::length_error("object key longer than 2 GiB");
+                return static_cast<uint32_t>(t.size());
+            }
 
-                    integer as_int() const override;
+            const char* text = "";
+            uint32_t length : 31;
+            uint32_t interned : 1;
+            uint32_t hash_value = hash_key_text(std::string_view());
+    };
 
-                    string as_string() const override;
-                    array as_array() const override;
-                private:
-                    real value;
-            };
+    std::ostream& operator<<(std::ostream&, const Key&);
 
-            class MString : public MultiTypeBase {
-                public:
-                    MString(const string& content);
+    // Deduplicated pool of object keys, shared by any number of documents.
+    // Interning is thread safe, and finding keys only takes a shared lock
+    // so parsers on many threads can use one table. Interned text lives
+    // as long as the table, which has to outlive every tree using it.
+    class KeyTable {
+        public:
+            static constexpr std::size_t DEFAULT_MAX_KEYS = 1 << 16;
 
-                    NodeType get_type() const override;
-                    real as_real() const override;
+            // past max_keys new keys are no longer interned, which bounds
+            // the table when keys come from untrusted input
+            KeyTable(std::size_t max_keys = DEFAULT_MAX_KEYS);
 
-                    integer as_int() const override;
+            KeyTable(const KeyTable&) = delete;
+            KeyTable& operator=(const KeyTable&) = delete;
 
-                    string as_string() const override;
-                    string& as_string_mut() override;
-                    const string& as_string_reference() override;
+            // The interned key for text. When the table is full a new key
+            // comes back un-interned, viewing text.
+            Key intern(std::string_view text);
+            // the interned key if there is one, an un-interned view of text if not
+            Key find(std::string_view text) const;
 
-                    //array as_array() const override;
-                private:
-                    string value;
-            };
+            std::size_t size() const;
 
-            class MArray : public MultiTypeBase {
-                public:
-                    MArray(const array& v);
+        private:
+            // slot position of text, or of the empty slot where it would go
+            std::size_t probe(std::string_view text, uint32_t hash) const;
+            void grow();
+
+            mutable std::shared_mutex mutex;
+            std::pmr::monotonic_buffer_resource text_pool;
+            // open addressing, a null text is an empty slot
+            std::vector<Key> slots;
+            std::size_t count = 0;
+            std::size_t max_keys;
+    };
 
-                    NodeType get_type() const override;
-                    string as_string() const override;
+    // Object storage. Members sit in one contiguous vector in insertion
+    // order. Small objects are searched linearly, and once an object grows
+    // past INDEX_THRESHOLD members an open addressing hash index over the
+    // vector is kept as well. Keys must not be changed through iterators.
+    //
+    // Interned keys are stored as they are. The text of any other key is
+    // copied into one buffer shared by all the object's keys.
+    class ObjectMap {
+        public:
+            typedef Key key_type;
+            typedef Node mapped_type;
+            typedef std::pair<key_type, Node> value_type;
+            typedef std::pmr::polymorphic_allocator<value_type> allocator_type;
+            typedef std::pmr::vector<value_type>::iterator iterator;
+            typedef std::pmr::vector<value_type>::const_iterator const_iterator;
+
+            static constexpr std::size_t INDEX_THRESHOLD = 8;
+
+            ObjectMap();
+            explicit ObjectMap(const allocator_type&);
+            ObjectMap(std::initializer_list<value_type>, const allocator_type& = allocator_type());
+
+            // Like the std::pmr containers, copies use the default resource.
+            // Copies also own all their key text, interned or not.
+            ObjectMap(const ObjectMap&);
+            ObjectMap(ObjectMap&&) noexcept;
+            ObjectMap& operator=(const ObjectMap&);
+            ObjectMap& operator=(ObjectMap&&);
+
+            allocator_type get_allocator() const;
+
+            iterator begin();
+            iterator end();
+            const_iterator begin() const;
+            const_iterator end() const;
+
+            std::size_t size() const;
+            bool empty() const;
+
+            // Lookups with an interned key skip hashing and compare by pointer.
+            iterator find(const Key&);
+            const_iterator find(const Key&) const;
+            std::size_t count(const Key&) const;
+            // throw std::out_of_range for missing keys, like std::map
+            Node& at(const Key&);
+            const Node& at(const Key&) const;
+            // inserts a null member if the key is missing
+            Node& operator[](const Key&);
+
+            // Inserts unless the key is already there, in a single lookup.
+            // The bool is false (and value untouched) for duplicates.
+            std::pair<iterator, bool> emplace(const Key& key, Node&& value);
+            std::pair<iterator, bool> insert(const value_type&);
+
+            // keeps the order of the remaining members
+            std::size_t erase(const Key&);
+            void clear();
+            void reserve(std::size_t);
+
+            // heap bytes of the members, index and key text, but not of the values' own children
+            std::size_t memory_usage() const;
 
-                    array as_array() const override;
-                    array& as_array_mut() override;
-                    const array& as_array_reference() const override;
-                private:
-                    array value;
+        private:
+            struct Slot {
+                uint32_t entry;
+                uint32_t hash;
             };
 
-            class MObject : public MultiTypeBase {
-                public:
-                    MObject(const object& v);
-
-                    NodeType get_type() const override;
-                    string as_string() const override;
+            static constexpr uint32_t EMPTY_SLOT = UINT32_MAX;
 
-                    object as_object() const override;
-                    object& as_object_mut() override;
-                    const object& as_object_reference() const override;
-                private:
-                    object value;
-            };
+            // position in entries, or entries.size() if missing
+            std::size_t find_position(const Key&) const;
+            void rebuild_index();
+            // the key to keep in entries, copying its text into key_bytes unless interned
+            Key store_key(const Key&);
 
+            std::pmr::vector<value_type> entries;
+            // empty while the object is small
+            std::pmr::vector<Slot> index;
+            std::pmr::vector<char> key_bytes;
     };
 
     //todo: whats
@@ -230,17 +359,1249 @@ namespace sjson
         class duplicate_label : public json_invalid {};
         class label_in_array: public json_invalid{};
         class missing_definition: public json_invalid{};
+        class unterminated_string: public json_invalid{};
+        class unexpected_end: public json_invalid{};
+        class invalid_number: public json_invalid{};
+        class invalid_escape: public json_invalid{};
+        class invalid_utf8: public json_invalid{
+            public:
+                invalid_utf8(std::size_t offset) : offset(offset) {}
+                // start of the first invalid sequence in the buffer
+                std::size_t offset;
+        };
+        // A ParseOptions limit was hit. Thrown before the offending value
+        // is added to the tree.
+        class limit_exceeded: public json_invalid{};
+        class too_many_bytes: public limit_exceeded{};
+        class too_many_nodes: public limit_exceeded{};
+        class too_deep: public limit_exceeded{};
+        class string_too_long: public limit_exceeded{};
+        // a Pointer's text isn't a valid RFC 6901 pointer
+        class invalid_pointer: public json_invalid{};
+
+        // Counters for one parse, only filled in when built with SJSON_STATS.
+        struct ParseStats {
+            std::size_t bytes = 0;
+            std::size_t tokens = 0;
+            // values built, indexed by NodeType
+            std::size_t nodes[OBJECT + 1] = {};
+            std::size_t max_depth = 0;
+            // heap taken for the tree: container and key storage, and
+            // strings too long for std::string's own buffer
+            std::size_t allocations = 0;
+            std::size_t allocated_bytes = 0;
+            // Wall time in nanoseconds. Tokenizing is the structural
+            // indexing, building is everything else and includes number
+            // conversion, which is timed on every 16th number and scaled.
+            uint64_t total_ns = 0;
+            uint64_t tokenize_ns = 0;
+            uint64_t build_ns = 0;
+            uint64_t number_ns = 0;
+
+            // adds in the stats of another part of the same input
+            void merge(const ParseStats& other);
+        };
+
+        struct ParseOptions {
+            // reject input that isn't valid utf-8, checked while indexing
+            bool validate_utf8 = false;
+            // set to collect counters for this parse
+            ParseStats* stats = nullptr;
+
+            // Limits for untrusted input, 0 means none. Exceeding one throws
+            // the matching limit_exceeded, before memory for it is taken.
+            // input size, checked before a stream is read further
+            std::size_t max_bytes = 0;
+            // values of any type, containers included
+            std::size_t max_nodes = 0;
+            // containers open at once
+            std::size_t max_depth = 0;
+            // bytes in a string or key, after unescaping
+            std::size_t max_string_length = 0;
+        };
+
+        // Receives the stats of sampled parses, to plug into tracing.
+        class ParseTracer {
+            public:
+                virtual ~ParseTracer() = default;
+                virtual void parse_started(std::size_t /*bytes*/) {}
+                // also called when the parse throws, with the counts so far
+                virtual void parse_finished(const ParseStats&) {}
+        };
+
+        // Collects stats for one in every sample_every parses and hands
+        // them to tracer, which has to be thread safe if parses are.
+        // nullptr stops tracing. Covers parse_from_* and Document::parse,
+        // and only works when built with SJSON_STATS.
+        void set_parse_tracer(ParseTracer* tracer, std::size_t sample_every = 1);
+
+        typedef enum {
+            TOKEN_END = 0,
+            TOKEN_OBJECT_OPEN, TOKEN_OBJECT_CLOSE,
+            TOKEN_ARRAY_OPEN, TOKEN_ARRAY_CLOSE,
+            TOKEN_NAME_SPECIFIER, TOKEN_END_PHRASE,
+            // quoted string, begin/end exclude the quotes
+            TOKEN_STRING,
+            // anything unquoted: numbers, null
+            TOKEN_BARE,
+        } TokenKind;
+
+        // A token is a range of offsets into the buffer being tokenized,
+        // nothing is copied out of it.
+        struct Token {
+            TokenKind kind = TOKEN_END;
+            std::size_t begin = 0;
+            std::size_t end = 0;
+            // string contains backslash escapes and needs unescaping
+            bool escaped = false;
+        };
+
+        // Tokenizes a contiguous buffer. The buffer must outlive the tokenizer.
+        class BufferTokenizer {
+            public:
+                BufferTokenizer(const char* data, std::size_t length);
+
+                // returns false (and a TOKEN_END token) once the buffer is exhausted
+                bool next(Token&);
+                std::size_t position() const;
+
+            private:
+                const char* data;
+                std::size_t length;
+                std::size_t cursor = 0;
+        };
+
+        typedef enum {
+            SIMD_NONE = 0,
+            SIMD_SSE2,
+            SIMD_AVX2,
+        } SimdLevel;
+
+        // best instruction set the running cpu supports
+        SimdLevel detect_simd_level();
+
+        // Offset of the first byte in text that a json string has to escape
+        // (a quote, backslash or control character), or length if none does.
+        std::size_t find_escape(const char* text, std::size_t length, SimdLevel level = detect_simd_level());
+
+        // Bitmasks for one 64 byte block, bit i is byte i.
+        struct BlockMasks {
+            uint64_t quote = 0;
+            uint64_t backslash = 0;
+            uint64_t structural = 0;
+            uint64_t whitespace = 0;
+            // bytes with the high bit set, the only ones utf-8 validation looks at
+            uint64_t non_ascii = 0;
+        };
+
+        // Checks utf-8 a block at a time, carrying an unfinished sequence
+        // over to the next block. Only blocks with non ascii bytes, or that
+        // continue a sequence, need to be fed to it.
+        class Utf8Validator {
+            public:
+                // base is the offset of bytes in the whole buffer,
+                // throws invalid_utf8 at the first bad sequence
+                void feed(const char* bytes, std::size_t length, std::size_t base);
+                // throws if the input ended partway through a sequence
+                void finish() const;
+                bool pending() const { return needed > 0; }
+
+            private:
+                // continuation bytes still to come, and the range the next one must be in
+                int needed = 0;
+                unsigned char low = 0x80;
+                unsigned char high = 0xbf;
+                std::size_t sequence_start = 0;
+        };
+
+        // Turns block masks into token start positions. Carries string,
+        // escape and bare token state from one block to the next.
+        class StructuralScanner {
+            public:
+                uint64_t scan(const BlockMasks&);
+
+            private:
+                uint64_t prev_escaped = 0;
+                uint64_t prev_in_string = 0;
+                uint64_t prev_bare = 0;
+        };
+
+        // Produces the same tokens as BufferTokenizer, but finds them from a
+        // structural index built a block at a time with SIMD. The index covers
+        // one chunk of the buffer at a time so it stays small for huge inputs.
+        class IndexedTokenizer {
+            public:
+                IndexedTokenizer(const char* data, std::size_t length, SimdLevel level = detect_simd_level(), bool validate_utf8 = false);
+
+                bool next(Token&);
+                std::size_t position() const;
+                // times indexing into stats, with SJSON_STATS
+                void collect(ParseStats* s) { stats = s; }
+
+            private:
+                bool next_structural(std::size_t& offset);
+                void index_chunk();
+
+                const char* data;
+                std::size_t length;
+                std::size_t cursor = 0;
+
+                SimdLevel level;
+                StructuralScanner scanner;
+                bool validate_utf8;
+                Utf8Validator utf8;
+
+                // offsets relative to chunk_base
+                std::vector<uint32_t> structurals;
+                std::size_t structural_cursor = 0;
+                std::size_t chunk_base = 0;
+                std::size_t indexed_up_to = 0;
+
+                ParseStats* stats = nullptr;
+        };
+
+        // Tokenizes input that arrives in pieces. A token cut off by the end
+        // of a piece is kept and finished from the next one, so pieces can
+        // be split anywhere, even inside a string escape or a number. Each
+        // piece only has to live until its tokens have been used.
+        class ChunkTokenizer {
+            public:
+                // with validate_utf8 each piece is checked as it starts, and
+                // a sequence cut off between pieces is finished from the next
+                ChunkTokenizer(bool validate_utf8 = false) : validate_utf8(validate_utf8) {}
+
+                // Bounds what can pile up between pieces: start_chunk throws
+                // too_many_bytes once more than max_bytes have come in, and a
+                // carried string throws string_too_long as soon as it can't
+                // fit max_string_length unescaped. 0 means no limit.
+                void limit(std::size_t max_string_length, std::size_t max_bytes) {
+                    this->max_string_length = max_string_length;
+                    this->max_bytes = max_bytes;
+                }
 
-        Node parse_from_istream(std::istream&);
-        Node from_file_path(const std::string&);
-        Node parse_from_string(const std::string&);
-        Node parse_from_string(const char*);
+                void start_chunk(const char* data, std::size_t length);
+                // Next complete token, with the buffer its offsets are into.
+                // Returns false once the piece is used up.
+                bool next(Token& token, const char*& base);
+                // Called at the end of the input. Gives a bare token that
+                // ran to the very end, and throws if a string or a utf-8
+                // sequence is still open.
+                bool finish(Token& token, const char*& base);
+
+            private:
+                // scans for the end of the carried token, returns whether it ended in this piece
+                bool complete_partial();
+                // throws once the carried string is sure to go over max_string_length
+                void check_partial() const;
+
+                const char* data = nullptr;
+                std::size_t length = 0;
+                std::size_t cursor = 0;
+
+                // the unfinished token, quote included for strings
+                std::string partial;
+                TokenKind partial_kind = TOKEN_END;
+                // the carried string ended on an unpaired backslash
+                bool partial_escape = false;
+                bool partial_escaped = false;
+
+                bool validate_utf8;
+                Utf8Validator utf8;
+                // bytes in earlier pieces, so invalid_utf8 offsets count from the start of the input
+                std::size_t consumed = 0;
+
+                std::size_t max_string_length = 0;
+                std::size_t max_bytes = 0;
+        };
+
+        Node token_to_node(const Token& token, const char* data);
+        // Parses a json number straight from its text. Returns INTEGER or
+        // REAL with the value in the matching out parameter, and integers
+        // too big for Node::integer come back as REAL. Text that isn't a
+        // number at all gives NONE, text that starts like one but is
+        // malformed throws invalid_number.
+        NodeType parse_number(const char* begin, const char* end, Node::integer& int_value, Node::real& real_value);
+        // The text of a string token, unescaped into scratch if it has escapes.
+        std::string_view token_text(const Token& token, const char* data, std::string& scratch);
+
+        // Receives a document as a stream of events, in document order.
+        // Keys and strings are only valid during the call. Derive from this
+        // to be called through virtuals, or give parse_sax any class with
+        // the same member functions to have them inlined instead.
+        class SaxHandler {
+            public:
+                virtual ~SaxHandler() = default;
+
+                virtual void start_object() {}
+                virtual void end_object() {}
+                virtual void start_array() {}
+                virtual void end_array() {}
+                virtual void key(std::string_view) {}
+
+                virtual void string(std::string_view) {}
+                virtual void integer(Node::integer) {}
+                virtual void real(Node::real) {}
+                virtual void boolean(bool) {}
+                virtual void null() {}
+        };
+
+        // Checks the grammar of a stream of tokens and turns it into handler
+        // events, keeping only a stack of open containers. Fed one token at
+        // a time, so it works with any tokenizer.
+        template <typename Handler>
+        class SaxParser {
+            public:
+                SaxParser(Handler& handler) : handler(handler) {}
+
+                // times number conversion into stats, with SJSON_STATS
+                void collect(ParseStats* s) {
+                    stats = s;
+                }
+
+                // takes the node, depth and string limits from options
+                void limit(const ParseOptions& options) {
+                    max_nodes = options.max_nodes;
+                    max_depth = options.max_depth;
+                    max_string_length = options.max_string_length;
+                }
+
+                void parse_token(const Token& token, const char* data) {
+                    switch (token.kind)
+                    {
+                    case TOKEN_OBJECT_OPEN:
+                        begin_value();
+                        open(OBJECT);
+                        handler.start_object();
+                        return;
+                    case TOKEN_OBJECT_CLOSE:
+                        close(OBJECT);
+                        handler.end_object();
+                        end_container();
+                        return;
+
+                    case TOKEN_ARRAY_OPEN:
+                        begin_value();
+                        open(ARRAY);
+                        handler.start_array();
+                        return;
+                    case TOKEN_ARRAY_CLOSE:
+                        close(ARRAY);
+                        handler.end_array();
+                        end_container();
+                        return;
+
+                    case TOKEN_NAME_SPECIFIER:
+                        if (state != EXPECT_NAME_SPECIFIER) {
+                            if (top_type() == ARRAY) throw json::label_in_array();
+                            throw json::wrong_delimeter();
+                        }
+                        state = EXPECT_VALUE;
+                        return;
+
+                    case TOKEN_END_PHRASE:
+                        if (nest_stack.empty()) throw json::wrong_delimeter();
+                        if (state != EXPECT_END) throw json::missing_definition();
+                        state = (JSON_ALLOW_TRAILING_COMMA)? EXPECT_FIRST : EXPECT_NEXT;
+                        return;
+
+                    case TOKEN_STRING:
+                        if (top_type() == OBJECT && (state == EXPECT_FIRST || state == EXPECT_NEXT)) {
+                            handler.key(string_text(token, data));
+                            state = EXPECT_NAME_SPECIFIER;
+                            return;
+                        }
+                        begin_value();
+                        handler.string(string_text(token, data));
+                        state = EXPECT_END;
+                        return;
+
+                    default:
+                        begin_value();
+                        bare_value(token, data);
+                        state = EXPECT_END;
+                        return;
+                    }
+                }
+
+                // Called once the input runs out. A lone scalar is a valid
+                // document, anything else still open is an error.
+                void finish() {
+                    if (done()) return;
+                    if (nest_stack.empty() && state == EXPECT_END) {
+                        _done = true;
+                        return;
+                    }
+                    throw json::unexpected_end();
+                }
+
+                // true once the outermost container is closed
+                bool done() const {
+                    return _done;
+                }
+
+            private:
+                typedef enum {
+                    // a value, or a key in an object
+                    EXPECT_VALUE,
+                    // first member of a container, or a close
+                    EXPECT_FIRST,
+                    // a member after a comma
+                    EXPECT_NEXT,
+                    EXPECT_NAME_SPECIFIER,
+                    // a comma or a close
+                    EXPECT_END,
+                } State;
+
+                NodeType top_type() const {
+                    return (nest_stack.empty())? NONE : nest_stack.back();
+                }
+
+                void begin_value() {
+                    if (state == EXPECT_END || state == EXPECT_NAME_SPECIFIER) throw json::missing_delimeter();
+                    if (top_type() == OBJECT && state != EXPECT_VALUE) throw json::missing_label();
+                    if (max_nodes > 0 && ++nodes_seen > max_nodes) throw json::too_many_nodes();
+                }
+
+                // before the handler hears of the container, so a limit stops it being built
+                void open(NodeType type) {
+                    if (max_depth > 0 && nest_stack.size() >= max_depth) throw json::too_deep();
+                    nest_stack.push_back(type);
+                    state = EXPECT_FIRST;
+                }
+
+                void close(NodeType type) {
+                    if (top_type() != type) throw json::wrong_closer();
+                    if (state == EXPECT_NAME_SPECIFIER || state == EXPECT_VALUE) throw json::missing_definition();
+                    if (state == EXPECT_NEXT) throw json::trailing_comma();
+                    nest_stack.pop_back();
+                }
+
+                // checked before the handler copies the text anywhere
+                std::string_view string_text(const Token& token, const char* data) {
+                    const std::string_view text = token_text(token, data, scratch);
+                    if (max_string_length > 0 && text.size() > max_string_length) throw json::string_too_long();
+                    return text;
+                }
+
+                void end_container() {
+                    state = EXPECT_END;
+                    if (nest_stack.empty()) _done = true;
+                }
+
+                void bare_value(const Token& token, const char* data) {
+                    const std::string_view text(data + token.begin, token.end - token.begin);
+                    if (text == "true") return handler.boolean(true);
+                    if (text == "false") return handler.boolean(false);
+
+                    Node::integer int_value;
+                    Node::real real_value;
+                #ifdef SJSON_STATS
+                    // two clock reads cost more than a conversion, so only a sample is timed
+                    if (stats != nullptr && (numbers_seen++ % NUMBER_SAMPLE) == 0) {
+                        const auto start = std::chrono::steady_clock::now();
+                        const NodeType type = parse_number(text.data(), text.data() + text.size(), int_value, real_value);
+                        stats->number_ns += NUMBER_SAMPLE * std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+                        if (type == INTEGER) return handler.integer(int_value);
+                        if (type == REAL) return handler.real(real_value);
+                        return handler.null();
+                    }
+                #endif
+                    switch (parse_number(text.data(), text.data() + text.size(), int_value, real_value))
+                    {
+                    case INTEGER:
+                        return handler.integer(int_value);
+                    case REAL:
+                        return handler.real(real_value);
+                    default:
+                        return handler.null();
+                    }
+                }
+
+                static constexpr std::size_t NUMBER_SAMPLE = 16;
+
+                Handler& handler;
+                std::vector<NodeType> nest_stack;
+                State state = EXPECT_VALUE;
+                bool _done = false;
+                // unescaped text of the last escaped string
+                std::string scratch;
+
+                ParseStats* stats = nullptr;
+                std::size_t numbers_seen = 0;
+
+                std::size_t max_nodes = 0;
+                std::size_t max_depth = 0;
+                std::size_t max_string_length = 0;
+                std::size_t nodes_seen = 0;
+        };
+
+        // Parses a whole buffer into handler events without building nodes.
+        template <typename Handler>
+        void parse_sax(const char* data, std::size_t length, Handler& handler, const ParseOptions& options = ParseOptions()) {
+            if (options.max_bytes > 0 && length > options.max_bytes) throw json::too_many_bytes();
+            SaxParser<Handler> parser(handler);
+            parser.limit(options);
+            IndexedTokenizer tokenizer(data, length, detect_simd_level(), options.validate_utf8);
+            Token token;
+            while (!parser.done() && tokenizer.next(token)) {
+                parser.parse_token(token, data);
+            }
+            parser.finish();
+        }
+
+        template <typename Handler>
+        void parse_sax(std::string_view text, Handler& handler, const ParseOptions& options = ParseOptions()) {
+            parse_sax(text.data(), text.size(), handler, options);
+        }
+
+        // Parses a document handed over in pieces as they arrive, such as
+        // reads from a socket, so parsing overlaps with receiving. The
+        // nesting state and any token cut off between pieces are kept from
+        // one feed() to the next. For a tree use a DomBuilder as the handler
+        // and take the root from it after finish().
+        template <typename Handler>
+        class PushParser {
+            public:
+                // validate_utf8 and the limits are taken from options, max_bytes
+                // counts everything fed so far
+                PushParser(Handler& handler, const ParseOptions& options = ParseOptions())
+                    : parser(handler), tokenizer(options.validate_utf8) {
+                    parser.limit(options);
+                    tokenizer.limit(options.max_string_length, options.max_bytes);
+                }
+
+                void feed(const char* data, std::size_t length) {
+                    tokenizer.start_chunk(data, length);
+                    Token token;
+                    const char* base;
+                    while (!parser.done() && tokenizer.next(token, base)) {
+                        parser.parse_token(token, base);
+                    }
+                }
+
+                void feed(std::string_view data) {
+                    feed(data.data(), data.size());
+                }
+
+                // the input is complete, throws if the document isn't
+                void finish() {
+                    Token token;
+                    const char* base;
+                    if (!parser.done() && tokenizer.finish(token, base)) {
+                        parser.parse_token(token, base);
+                    }
+                    parser.finish();
+                }
+
+                // true once the outermost container is closed
+                bool done() const {
+                    return parser.done();
+                }
 
-        void write_node_to_file(const Node& node, const std::string& path);
+            private:
+                SaxParser<Handler> parser;
+                ChunkTokenizer tokenizer;
+        };
+
+        // The SAX handler that builds a Node tree. Containers are built in
+        // place in their parent, so nothing is moved once added. Collections
+        // come from resource, and with arena_strings set strings are copied
+        // into it and borrowed. Object keys are interned into keys when one
+        // is given.
+        class DomBuilder {
+            public:
+                // Strings that are views into borrowable, which has to
+                // outlive the tree, are borrowed rather than copied. Those
+                // are the input's strings that had no escapes.
+                DomBuilder(std::pmr::memory_resource* resource = std::pmr::get_default_resource(), bool arena_strings = false, KeyTable* keys = nullptr,
+                    std::string_view borrowable = std::string_view());
+
+                void start_object();
+                void end_object();
+                void start_array();
+                void end_array();
+                void key(std::string_view);
+
+                void string(std::string_view);
+                void integer(Node::integer);
+                void real(Node::real);
+                // there is no boolean node, so these become 1 and 0
+                void boolean(bool);
+                void null();
+
+                // moves the finished tree out of the builder
+                Node take_root();
+
+                // counts nodes, depth and allocations into stats, with SJSON_STATS
+                void collect(ParseStats* s);
+
+            private:
+                // where the next value goes
+                Node& next_slot();
+                void count_node(NodeType type);
+
+                std::pmr::memory_resource* resource;
+                bool arena_strings;
+                KeyTable* keys;
+                std::string_view borrowable;
+                ParseStats* stats = nullptr;
+
+                Node root;
+                std::vector<Node*> nest_stack;
+                // value of the member whose key was just read
+                Node* member = nullptr;
+        };
+
+        // A value in a buffer that is only parsed as far as it is read.
+        // Looking up a member or element walks the container up to it and
+        // skips everything in between by bracket matching, without building
+        // nodes or allocating. A value is just an offset, so it is cheap to
+        // copy, and the buffer has to outlive it.
+        class LazyValue {
+            public:
+                LazyValue(const char* data, std::size_t length, std::size_t begin);
+
+                NodeType get_type() const;
+                bool is_null() const;
+
+                // member of an object, throws std::out_of_range if there isn't one
+                LazyValue operator[](std::string_view key) const;
+                // element of an array, throws std::out_of_range past the end
+                LazyValue operator[](std::size_t index) const;
+                std::optional<LazyValue> find(std::string_view key) const;
+                // members or elements, counted without parsing them
+                std::size_t size() const;
+
+                // numbers coerce between each other like Node, anything else throws coercion_invalid
+                Node::integer get_int() const;
+                Node::real get_real() const;
+                // throws wrong_type if this isn't a string
+                std::string get_string() const;
+
+                // the value's text as written, quotes and brackets included
+                std::string_view raw() const;
+                // fully parses this value and everything under it
+                Node to_node() const;
+
+            private:
+                // calls visit(key or element index, value start) per child until it returns true
+                template <typename Visit>
+                void walk(Visit visit) const;
+                Token bare_token() const;
+
+                const char* data;
+                std::size_t length;
+                std::size_t begin;
+        };
+
+        // The root value of buffer, read lazily. Nothing is parsed up front.
+        LazyValue parse_on_demand(std::string_view buffer);
+        LazyValue parse_on_demand(const char* data, std::size_t length);
+
+        // A compiled RFC 6901 JSON Pointer, such as "/users/0/name". The
+        // text is split, unescaped and hashed and its array indices parsed
+        // once, so a lookup only walks the tree. Copies share the compiled
+        // text.
+        class Pointer {
+            public:
+                // Throws invalid_pointer for text that isn't empty and doesn't
+                // start with '/', or has a '~' not followed by 0 or 1. With
+                // keys, the tokens are interned so members of trees built
+                // with the same table match by pointer.
+                Pointer(std::string_view text, KeyTable* keys = nullptr);
+
+                // What the pointer refers to, or nullptr if nothing is there,
+                // including when a step meets a scalar. Never throws or allocates.
+                const Node* find(const Node& root) const;
+                Node* find(Node& root) const;
+
+                // reference tokens, 0 for the whole document
+                std::size_t size() const;
+                // the pointer's text, escaped again
+                std::string to_string() const;
+
+            private:
+                friend class PointerSet;
+
+                static constexpr std::size_t NO_INDEX = SIZE_MAX;
+
+                struct Step {
+                    Key key;
+                    // the token as an array index, NO_INDEX if it can't be one
+                    std::size_t index;
+                };
+
+                // the child of node a step leads to, if there is one
+                static const Node* step_into(const Node& node, const Step& step);
+
+                // the unescaped tokens back to back, keys view into it
+                std::shared_ptr<const std::string> tokens;
+                std::vector<Step> steps;
+        };
+
+        // Many pointers looked up in one tree together. Pointers are kept
+        // as a tree of their steps, so a prefix they share is walked once.
+        class PointerSet {
+            public:
+                // position of the pointer's result
+                std::size_t add(const Pointer&);
+                std::size_t size() const;
+
+                // results[i] becomes what pointer i refers to, or nullptr.
+                // Only allocates if results has to grow.
+                void find(const Node& root, std::vector<const Node*>& results) const;
+
+            private:
+                struct Branch {
+                    Pointer::Step step;
+                    std::vector<std::size_t> children;
+                    // pointers that end at this step
+                    std::vector<std::size_t> ends;
+                };
+
+                void visit(std::size_t branch, const Node& node, const Node** results) const;
+
+                // branch 0 is the root, its step is unused
+                std::vector<Branch> branches = std::vector<Branch>(1);
+                // keep the text the steps view alive
+                std::vector<Pointer> pointers;
+        };
+
+        // A whole file, mapped read only and unmapped when destroyed. Where
+        // there is no mmap the file is read into memory instead. Throws
+        // std::system_error if the file can't be opened.
+        class MappedFile {
+            public:
+                explicit MappedFile(const std::string& path);
+                ~MappedFile();
+
+                MappedFile(const MappedFile&) = delete;
+                MappedFile& operator=(const MappedFile&) = delete;
+
+                const char* data() const { return bytes; }
+                std::size_t size() const { return length; }
+                std::string_view view() const { return std::string_view(bytes, length); }
+
+            private:
+                const char* bytes = nullptr;
+                std::size_t length = 0;
+            #ifndef SJSON_MMAP
+                std::string contents;
+            #endif
+        };
+
+        Node parse_from_istream(std::istream&, const ParseOptions& options = ParseOptions());
+        // parses straight out of a MappedFile, without copying the file
+        Node from_file_path(const std::string&, const ParseOptions& options = ParseOptions());
+        Node parse_from_string(const std::string&, const ParseOptions& options = ParseOptions());
+        Node parse_from_string(const char*, const ParseOptions& options = ParseOptions());
+        Node parse_from_string(std::string_view, const ParseOptions& options = ParseOptions());
+        Node parse_from_buffer(const char* data, std::size_t length, const ParseOptions& options = ParseOptions());
+
+        struct ParallelOptions {
+            // worker threads, zero for one per core
+            unsigned int threads = 0;
+            // the least each thread is given, smaller documents are parsed sequentially
+            std::size_t min_segment_bytes = 1 << 20;
+            ParseOptions parse;
+        };
+
+        // Parses one document whose top level is an array or object on
+        // several threads. The top level is split into runs of whole elements
+        // or members, each run is parsed on its own and the pieces are joined
+        // in order. Gives the same tree as parse_from_buffer; a document that
+        // fails is parsed again sequentially so it throws the same error too.
+        // Stats are collected per run and added up, so times are the sum
+        // over all threads rather than wall time.
+        Node parse_parallel(const char* data, std::size_t length, const ParallelOptions& options = ParallelOptions());
+        Node parse_parallel(std::string_view text, const ParallelOptions& options = ParallelOptions());
+
+        struct LinesOptions {
+            // worker threads, zero for one per core
+            unsigned int threads = 0;
+            // records go to the workers in batches of about this many bytes
+            std::size_t batch_bytes = 1 << 20;
+            // batches parsed ahead of the one being delivered, zero for two
+            // per thread. This is what bounds memory use on huge inputs.
+            std::size_t batches_in_flight = 0;
+            ParseOptions parse;
+        };
+
+        // line numbers start at one, and blank lines are counted but skipped
+        typedef std::function<void(std::size_t line, Node&& record)> LineCallback;
+        typedef std::function<void(std::size_t line, std::exception_ptr error)> LineErrorCallback;
+
+        // Parses newline delimited json, one document per line, on a pool of
+        // worker threads. Callbacks run on the calling thread in line order.
+        // A line that fails to parse goes to on_error and the rest carry on.
+        // An exception thrown by a callback stops the workers and is rethrown.
+        // Stats are added up over every line, so times are the sum over all
+        // threads rather than wall time.
+        void parse_lines(const char* data, std::size_t length, const LineCallback& on_record, const LineErrorCallback& on_error, const LinesOptions& options = LinesOptions());
+        void parse_lines(std::string_view text, const LineCallback& on_record, const LineErrorCallback& on_error, const LinesOptions& options = LinesOptions());
+
+        // Where a JsonWriter's output goes. The writer buffers and hands
+        // over large blocks, never single fragments.
+        class JsonSink {
+            public:
+                virtual ~JsonSink() = default;
+                virtual void write(const char* data, std::size_t length) = 0;
+        };
+
+        class StreamSink : public JsonSink {
+            public:
+                StreamSink(std::ostream& stream) : stream(stream) {}
+                void write(const char* data, std::size_t length) override;
+
+            private:
+                std::ostream& stream;
+        };
+
+        struct JsonFormat {
+            // off writes compact json without any whitespace
+            bool pretty = false;
+            char indent_char = '\t';
+            unsigned int indent_width = 1;
+
+            static JsonFormat compact() {
+                return JsonFormat();
+            }
+            // a newline per member, indented by indent_width per level
+            static JsonFormat indented(char indent_char = '\t', unsigned int indent_width = 1) {
+                JsonFormat format;
+                format.pretty = true;
+                format.indent_char = indent_char;
+                format.indent_width = indent_width;
+                return format;
+            }
+        };
+
+        // Serializes json into one contiguous buffer. With a sink the buffer
+        // stays one block in size and is flushed to the sink whenever it
+        // fills, otherwise it grows and output() gives the result.
+        //
+        // Besides write(), it takes the same calls as a SAX handler, so
+        // parse_sax can feed it directly to reformat json.
+        class JsonWriter {
+            public:
+                static constexpr std::size_t BLOCK_SIZE = 1 << 16;
+
+                JsonWriter(const JsonFormat& format = JsonFormat(), JsonSink* sink = nullptr);
+
+                void write(const Node&);
+
+                void start_object();
+                void end_object();
+                void start_array();
+                void end_array();
+                void key(std::string_view);
+                void string(std::string_view);
+                void integer(Node::integer);
+                // infinities and nan aren't json, they are written as null
+                void real(Node::real);
+                void boolean(bool);
+                void null();
+
+                // hands everything buffered to the sink
+                void flush();
+                // what has been written so far, when there is no sink
+                std::string_view output() const;
+                std::string take_output();
+
+            private:
+                // pointer to at least bytes of free buffer
+                char* make_room(std::size_t bytes);
+                void append(const char* data, std::size_t length);
+                void put(char c);
+                void before_value();
+                void new_line();
+                void write_escaped(std::string_view);
+
+                JsonFormat format;
+                JsonSink* sink;
+                SimdLevel simd = detect_simd_level();
+
+                std::string buffer;
+                std::size_t used = 0;
+
+                // newline followed by the deepest indent needed so far
+                std::string indent_text;
+                std::size_t depth = 0;
+                bool first_in_container = true;
+                bool after_key = false;
+        };
+
+        void write_node_as_json(const Node& node, std::ostream& stream, const JsonFormat& format = JsonFormat::indented());
+        Node::string node_to_json_string(const Node& node, const JsonFormat& format = JsonFormat::indented());
+        void write_node_to_file(const Node& node, const std::string& path, const JsonFormat& format = JsonFormat::indented());
     }
 
+    // Owns every node of a parsed tree in one arena. Dropping the document
+    // releases the arena in one go instead of freeing node by node, and
+    // reset() keeps the memory for the next parse.
+    //
+    // Strings in the tree borrow from the arena, so read them with
+    // as_string_view(). Don't move nodes out of a document, copy them.
+    //
+    // Object keys are interned into a KeyTable that outlives resets, so
+    // repeated keys are stored once. Documents parsing the same kind of
+    // data can share one table, which then has to outlive them.
+    class Document {
+        public:
+            Document(std::size_t initial_size = 0, KeyTable* shared_keys = nullptr);
+            ~Document();
+
+            Document(const Document&) = delete;
+            Document& operator=(const Document&) = delete;
+
+            // both replace the current tree
+            const Node& parse(std::string_view, const json::ParseOptions& options = json::ParseOptions());
+            const Node& parse(std::istream&, const json::ParseOptions& options = json::ParseOptions());
+            // Maps the file and parses straight out of the mapping, which
+            // the document keeps until the next parse or reset. With
+            // borrow_strings, strings without escapes view the mapped bytes
+            // instead of being copied into the arena.
+            const Node& load_file(const std::string& path, const json::ParseOptions& options = json::ParseOptions(), bool borrow_strings = true);
+
+            const Node& root() const;
+            // Nodes added through this can own heap memory, so after calling
+            // it the tree is destroyed node by node like a normal Node.
+            Node& root_mut();
+
+            // drops the tree and rewinds the arena
+            void reset();
+
+            // heap memory the arena has taken since the last reset,
+            // not counting the block kept from earlier parses
+            std::size_t arena_overflow() const;
+
+        private:
+            // passes allocations to the heap and remembers how much was taken
+            class CountingResource : public std::pmr::memory_resource {
+                public:
+                    std::size_t allocated = 0;
+                private:
+                    void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+                    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override;
+                    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+            };
+
+            void release_tree();
+
+            CountingResource upstream;
+            std::unique_ptr<char[]> block;
+            std::size_t block_size = 0;
+            std::optional<std::pmr::monotonic_buffer_resource> arena;
+            std::unique_ptr<KeyTable> own_keys;
+            KeyTable* keys;
+            // the file load_file parsed, kept while the tree may view it
+            std::unique_ptr<json::MappedFile> mapping;
+
+            // never destroyed unless mutated, the arena owns everything in it
+            union {
+                Node tree;
+            };
+            bool has_tree = false;
+            bool mutated = false;
+    };
+
     namespace messagepack {
+        class messagepack_invalid : public std::exception {};
+        class unexpected_end : public messagepack_invalid {};
+        // 0xc1 and the ext types, which a Node has no way to hold
+        class unsupported_type : public messagepack_invalid {};
+        // map keys have to be str or bin
+        class invalid_key : public messagepack_invalid {};
+        class duplicate_key : public messagepack_invalid {};
+        class too_deep : public messagepack_invalid {};
+        class trailing_data : public messagepack_invalid {};
+
+        // nesting past this throws too_deep instead of running out of stack
+        static constexpr std::size_t MAX_DEPTH = 1024;
+
+        // Reads big endian values from a buffer, throwing unexpected_end
+        // rather than reading past it.
+        class ByteCursor {
+            public:
+                ByteCursor(const char* data, std::size_t length)
+                    : data(reinterpret_cast<const unsigned char*>(data)), length(length) {}
+
+                // unsigned types only
+                template <typename T>
+                T take() {
+                    if (length - at < sizeof(T)) throw messagepack::unexpected_end();
+                    T value = 0;
+                    for (std::size_t i = 0; i < sizeof(T); i++) {
+                        value = static_cast<T>((static_cast<uint64_t>(value) << 8) | data[at + i]);
+                    }
+                    at += sizeof(T);
+                    return value;
+                }
+
+                std::string_view take_bytes(std::size_t count) {
+                    if (length - at < count) throw messagepack::unexpected_end();
+                    const std::string_view bytes(reinterpret_cast<const char*>(data + at), count);
+                    at += count;
+                    return bytes;
+                }
+
+                // a str or bin, the only types a map key can have
+                std::string_view take_key();
+
+                std::size_t position() const { return at; }
+                std::size_t remaining() const { return length - at; }
+
+            private:
+                const unsigned char* data;
+                std::size_t length;
+                std::size_t at = 0;
+        };
+
+        // If type starts an array or map, reads its length into count and returns true.
+        bool read_container_header(uint8_t type, ByteCursor& in, std::size_t& count, bool& map);
+
+        // Reads any value but an array or map and passes it to a SAX handler.
+        template <typename Handler>
+        void read_scalar(uint8_t type, ByteCursor& in, Handler& handler) {
+            // the fix forms carry their value or length in the type byte
+            if (type <= 0x7f || type >= 0xe0) {
+                handler.integer(static_cast<int8_t>(type));
+                return;
+            }
+            if ((type & 0xe0) == 0xa0) {
+                handler.string(in.take_bytes(type & 0x1f));
+                return;
+            }
+
+            switch (type)
+            {
+            case 0xc0:
+                handler.null();
+                return;
+            case 0xc2:
+            case 0xc3:
+                handler.boolean(type == 0xc3);
+                return;
+
+            case 0xc4:
+            case 0xd9:
+                handler.string(in.take_bytes(in.take<uint8_t>()));
+                return;
+            case 0xc5:
+            case 0xda:
+                handler.string(in.take_bytes(in.take<uint16_t>()));
+                return;
+            case 0xc6:
+            case 0xdb:
+                handler.string(in.take_bytes(in.take<uint32_t>()));
+                return;
+
+            case 0xca:
+                {
+                    const uint32_t bits = in.take<uint32_t>();
+                    float value;
+                    std::memcpy(&value, &bits, sizeof(value));
+                    handler.real(value);
+                    return;
+                }
+            case 0xcb:
+                {
+                    const uint64_t bits = in.take<uint64_t>();
+                    double value;
+                    std::memcpy(&value, &bits, sizeof(value));
+                    handler.real(value);
+                    return;
+                }
+
+            case 0xcc:
+                handler.integer(in.take<uint8_t>());
+                return;
+            case 0xcd:
+                handler.integer(in.take<uint16_t>());
+                return;
+            case 0xce:
+                handler.integer(in.take<uint32_t>());
+                return;
+            case 0xcf:
+                {
+                    const uint64_t value = in.take<uint64_t>();
+                    if (value > static_cast<uint64_t>(std::numeric_limits<Node::integer>::max())) {
+                        handler.real(static_cast<Node::real>(value));
+                    }
+                    else {
+                        handler.integer(static_cast<Node::integer>(value));
+                    }
+                    return;
+                }
+
+            case 0xd0:
+                handler.integer(static_cast<int8_t>(in.take<uint8_t>()));
+                return;
+            case 0xd1:
+                handler.integer(static_cast<int16_t>(in.take<uint16_t>()));
+                return;
+            case 0xd2:
+                handler.integer(static_cast<int32_t>(in.take<uint32_t>()));
+                return;
+            case 0xd3:
+                handler.integer(static_cast<int64_t>(in.take<uint64_t>()));
+                return;
+
+            default:
+                throw messagepack::unsupported_type();
+            }
+        }
+
+        // Reads one value as the same calls json::parse_sax makes, so any
+        // json handler works, for instance a json::JsonWriter to turn
+        // messagepack into json. Booleans stay booleans and bin is passed
+        // as a string. Open containers are a stack of counts, so memory
+        // only grows with nesting. used works as in parse_from_buffer.
+        template <typename Handler>
+        void parse_sax(const char* data, std::size_t length, Handler& handler, std::size_t* used = nullptr) {
+            struct Open {
+                // elements or members still to come
+                std::size_t left;
+                bool map;
+            };
+
+            ByteCursor in(data, length);
+            std::vector<Open> open;
+            do {
+                if (!open.empty()) {
+                    if (open.back().map) handler.key(in.take_key());
+                    open.back().left--;
+                }
+
+                const uint8_t type = in.take<uint8_t>();
+                std::size_t count;
+                bool map;
+                if (!read_container_header(type, in, count, map)) {
+                    read_scalar(type, in, handler);
+                }
+                else {
+                    if (open.size() >= MAX_DEPTH) throw messagepack::too_deep();
+                    if (map) handler.start_object();
+                    else handler.start_array();
+                    open.push_back({count, map});
+                }
+
+                while (!open.empty() && open.back().left == 0) {
+                    if (open.back().map) handler.end_object();
+                    else handler.end_array();
+                    open.pop_back();
+                }
+            } while (!open.empty());
+
+            if (used) *used = in.position();
+            else if (in.position() != length) throw messagepack::trailing_data();
+        }
+
+        template <typename Handler>
+        void parse_sax(std::string_view bytes, Handler& handler) {
+            messagepack::parse_sax(bytes.data(), bytes.size(), handler);
+        }
+
+        // Decodes one value from a buffer. nil is null and booleans are the
+        // integers 1 and 0, as in json. bin is read as a string, and unsigned
+        // values past the int64 range come back as reals. Arrays and maps
+        // are reserved from their length prefix. If used is given the value
+        // can be followed by more data, and used is set to the value's
+        // length; otherwise leftover bytes throw trailing_data.
+        Node parse_from_buffer(const char* data, std::size_t length, std::size_t* used = nullptr);
+        Node parse_from_string(std::string_view);
         Node parse_from_istream(std::istream&);
+
+        // a string, array or map with more than 2^32 - 1 bytes or elements
+        class too_large : public messagepack_invalid {};
+
+        // Bytes write gives for node, worked out without writing anything.
+        std::size_t encoded_size(const Node& node);
+        // Appends node to out, using the smallest form for every integer,
+        // string and container header. Reals that a float holds exactly
+        // are written as float 32. With exact_size the output size is
+        // worked out first, so out is grown once instead of as it fills.
+        void write(const Node& node, std::string& out, bool exact_size = false);
+        std::string write(const Node& node, bool exact_size = false);
+
+        // Writes messagepack into a string grown ahead of the writes, so
+        // the bytes themselves go through a plain pointer. Every value
+        // takes its smallest form.
+        class Packer {
+            public:
+                // size is what the output is expected to take, zero if unknown
+                Packer(std::string& out, std::size_t size = 0);
+                ~Packer();
+
+                void pack(const Node& node);
+                void pack_integer(Node::integer value);
+                void pack_real(Node::real value);
+                void pack_string(std::string_view text);
+                void pack_boolean(bool value);
+                void pack_null();
+                // fix_type is the fix form's type byte, wide_type the 16 bit form's
+                void pack_header(std::size_t count, uint8_t fix_type, std::size_t fix_max, uint8_t wide_type);
+
+                // A 32 bit array or map header, the count filled in later by
+                // patch_count. Returns the header's offset in the output.
+                std::size_t pack_open(uint8_t type);
+                void patch_count(std::size_t offset, std::size_t count);
+
+                // trims the output to what has been written
+                void finish();
+
+            private:
+                void room(std::size_t count);
+                // type byte and a big endian value of the given width
+                void put(uint8_t type, uint64_t value, std::size_t bytes);
+
+                std::string& out;
+                std::size_t at;
+        };
+
+        // A SAX handler that writes messagepack, so json::parse_sax or a
+        // json::PushParser turn json into messagepack without a tree. A
+        // container's length isn't known when it opens, so its header is
+        // written in the 32 bit form and the count filled in when it
+        // closes. Scalars and keys still get their smallest form.
+        class Encoder {
+            public:
+                Encoder(std::string& out);
+
+                void start_object();
+                void end_object();
+                void start_array();
+                void end_array();
+                void key(std::string_view);
+                void string(std::string_view);
+                void integer(Node::integer);
+                void real(Node::real);
+                void boolean(bool);
+                void null();
+
+                // call once the document is done, trims the output
+                void finish();
+
+            private:
+                // counts the value towards an open array
+                void begin_value();
+
+                struct Open {
+                    std::size_t header;
+                    std::size_t count;
+                    bool map;
+                };
+
+                Packer packer;
+                std::vector<Open> open;
+        };
+
+        // json text to messagepack in one pass, appended to out
+        void from_json(const char* data, std::size_t length, std::string& out, const json::ParseOptions& options = json::ParseOptions());
+        std::string from_json(std::string_view text, const json::ParseOptions& options = json::ParseOptions());
+        // messagepack to json in one pass, written to writer without flushing it
+        void to_json(const char* data, std::size_t length, json::JsonWriter& writer);
+        std::string to_json(std::string_view bytes, const json::JsonFormat& format = json::JsonFormat::compact());
     }
 
 } // namespace sjson
@@ -251,13 +1612,42 @@ namespace sjson
 
 #ifdef SJSON_OBJECT
 #include <cassert>
+#include <cstring>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <charconv>
+#include <limits>
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
 #include <fstream>
 
+#include <system_error>
+#include <cerrno>
+
+#ifdef SJSON_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#ifdef SJSON_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #ifdef SJSON_TEST
 #include <iostream>
 #define DEBUG_PRINT(X) std::cerr << "[----------] " << X << '\n'
+namespace sjson { namespace test_counters {
+    // deep copies of arrays/objects, so tests can check the parser only moves
+    std::size_t deep_copies = 0;
+} }
+#define COUNT_DEEP_COPY() (++sjson::test_counters::deep_copies)
 #else
 #define DEBUG_PRINT(X)
+#define COUNT_DEEP_COPY()
 #endif
 
     
@@ -270,226 +1660,103 @@ namespace sjson
 
 namespace sjson {
 
-    // by default, all conversion funcs throw invalid
-    // there's probably a way to make this more extensible with templates
-    // also shorter
-
-    //==================================================
-    Node::MultiTypeBase::~MultiTypeBase() {}
-    Node::real Node::MultiTypeBase::as_real() const {
-        throw Node::coercion_invalid();
-    }
-    Node::real& Node::MultiTypeBase::as_real_mut() {
-        throw Node::wrong_type();
-    }
+    #define USE_SUBCLASS(CLASS,MEMBER_CLASS) typedef CLASS::MEMBER_CLASS MEMBER_CLASS
 
-    //==================================================
-    Node::integer Node::MultiTypeBase::as_int() const {
-        throw Node::coercion_invalid();
-    }
-    Node::integer& Node::MultiTypeBase::as_int_mut() {
-        throw Node::wrong_type();
-    }
+    USE_SUBCLASS(Node, object);
+    USE_SUBCLASS(Node, array);
+    USE_SUBCLASS(Node, string);
+    USE_SUBCLASS(Node, integer);
+    USE_SUBCLASS(Node, real);
 
-    //==================================================
-    Node::string Node::MultiTypeBase::as_string() const {
-        throw coercion_invalid();
-    }
-    Node::string& Node::MultiTypeBase::as_string_mut() {
-        throw wrong_type();
-    }
-    const Node::string& Node::MultiTypeBase::as_string_reference() {
-        throw wrong_type();
+    // Collections are created and destroyed through the memory resource
+    // they carry, so the same code serves heap nodes and Document arenas.
+    template <typename Collection>
+    Collection* create_collection(Collection&& content) {
+        std::pmr::polymorphic_allocator<Collection> alloc(content.get_allocator().resource());
+        Collection* created = alloc.allocate(1);
+        new (created) Collection(std::move(content));
+        return created;
     }
 
-    //==================================================
-    Node::array Node::MultiTypeBase::as_array() const {
-        throw coercion_invalid();
-    }
-    Node::array& Node::MultiTypeBase::as_array_mut() {
-        throw wrong_type();
-    }
-    const Node::array& Node::MultiTypeBase::as_array_reference() const {
-        throw wrong_type();
+    template <typename Collection>
+    void destroy_collection(Collection* collection) {
+        std::pmr::polymorphic_allocator<Collection> alloc(collection->get_allocator().resource());
+        collection->~Collection();
+        alloc.deallocate(collection, 1);
     }
 
-    //==================================================
-    Node::object Node::MultiTypeBase::as_object() const {
-        throw coercion_invalid();
-    }
-    Node::object& Node::MultiTypeBase::as_object_mut() {
-        throw wrong_type();
-    }
-    const Node::object& Node::MultiTypeBase::as_object_reference() const {
-        throw wrong_type();
-    }
+    // Coercion rules are a switch over base_type. Anything not handled
+    // falls through to coercion_invalid (for as_*) or wrong_type (for the
+    // reference accessors).
 
-    //= NULL =============================================
-    NodeType Node::Mnull::get_type() const {
-        return NONE;
-    }
-    Node::real Node::Mnull::as_real() const {
-        return 0;
-    }
-    Node::integer Node::Mnull::as_int() const {
-        return 0;
+    NodeType Node::get_type() const {
+        return base_type;
     }
 
-    //= INTEGER ==========================================
-    Node::MInt::MInt(const integer& v) : value(v) {}
-    NodeType Node::MInt::get_type() const {
-        return INTEGER;
-    }
-    Node::integer Node::MInt::as_int() const {
-        return value;
-    }
-    Node::integer& Node::MInt::as_int_mut() {
-        return value;
-    }
-    Node::real Node::MInt::as_real() const {
-        return static_cast<real>(value);
-    }
-    Node::string Node::MInt::as_string() const {
-        return std::to_string(value);
-    }
-    Node::array Node::MInt::as_array() const {
-        return {value};
-    }
-    //= REAL =============================================
-    Node::MReal::MReal(const real& v) : value(v) {}
-    NodeType Node::MReal::get_type() const {
-        return REAL;
-    }
-    Node::real Node::MReal::as_real() const {
-        return value;
-    }
-    Node::real& Node::MReal::as_real_mut() {
-        return value;
-    }
-    Node::integer Node::MReal::as_int() const {
-        return static_cast<integer>(value);
-    }
-    Node::string Node::MReal::as_string() const {
-        return std::to_string(value);
-    }
-    Node::array Node::MReal::as_array() const {
-        return {value};
-    }
-    //= STRING ===========================================
-    Node::MString::MString(const string& v) : value(v) {}
-    NodeType Node::MString::get_type() const {
-        return STRING;
-    }
-    Node::string Node::MString::as_string() const {
-        return value;
-    }
-    Node::string& Node::MString::as_string_mut() {
-        return value;
-    }
-    const Node::string& Node::MString::as_string_reference() {
-        return value;
-    }
+    Node::Node() : base_type(NONE), int_value(0) {}
 
-    Node::integer Node::MString::as_int() const {
-        try {
-            return std::stol(value);
-        }
-        catch(std::invalid_argument& e) {
-            throw coercion_invalid();
-        }
-    }
-    Node::real Node::MString::as_real() const {
-        try {
-            return std::stof(value);
-        }
-        catch (std::invalid_argument& e) {
-            throw coercion_invalid();
-        }
-    }
-    //= ARRAY ============================================
-    Node::MArray::MArray(const array& v) : value(v) {}
-    NodeType Node::MArray::get_type() const  {
-        return ARRAY;
-    }
-    Node::array Node::MArray::as_array() const {
-        return value;
-    }
-    Node::array& Node::MArray::as_array_mut() {
-        return value;
-    }
-    const Node::array& Node::MArray::as_array_reference() const {
-        return value;
+    Node::Node(const Node& base) : base_type(NONE), int_value(0) {
+        _copy_variant(base);
     }
 
-    Node::string Node::MArray::as_string() const {
-        return _array_to_string(value);
+    Node::Node(Node&& base) noexcept : base_type(NONE), int_value(0) {
+        _move_variant(base);
     }
 
-    //todo: tostring
-    //= OBJECT ===========================================
-    Node::MObject::MObject(const object& v) : value(v) {}
-    NodeType Node::MObject::get_type() const {
-        return OBJECT;
+    Node::Node(const string& content) : base_type(STRING) {
+        new (&string_value) string(content);
     }
-    Node::object Node::MObject::as_object() const {
-        return value;
-    }
-    Node::object& Node::MObject::as_object_mut() {
-        return value;
-    }
-    const Node::object& Node::MObject::as_object_reference() const {
-        return value;
-    }
-    Node::string Node::MObject::as_string() const {
-        return _object_to_string(value);
-    }
-
-    #define USE_SUBCLASS(CLASS,MEMBER_CLASS) typedef CLASS::MEMBER_CLASS MEMBER_CLASS
-
-    USE_SUBCLASS(Node, object);
-    USE_SUBCLASS(Node, array);
-    USE_SUBCLASS(Node, string);
-    USE_SUBCLASS(Node, integer);
-    USE_SUBCLASS(Node, real);
 
-    NodeType Node::get_type() const {
-        return variant->get_type();
+    Node::Node(string&& content) : base_type(STRING) {
+        new (&string_value) string(std::move(content));
     }
 
-    Node::Node() {
-        variant = new Mnull();
-    }
+    Node::Node(const integer& content) : base_type(INTEGER), int_value(content) {}
 
-    Node::Node(const Node& base) {
-        _copy_variant(base);
-    }
+    Node::Node(const real& content) : base_type(REAL), real_value(content) {}
 
-    Node::Node(const string& content) {
-        variant = new MString(content);
+    Node::Node(const array& content) : base_type(ARRAY) {
+        array_value = create_collection(array(content));
     }
 
-    Node::Node(const integer& content) {
-        variant = new MInt(content);
+    Node::Node(array&& content) : base_type(ARRAY) {
+        array_value = create_collection(std::move(content));
     }
 
-    Node::Node(const real& content) {
-        variant = new MReal(content);
+    Node::Node(const object& content) : base_type(OBJECT) {
+        object_value = create_collection(object(content));
     }
 
-    Node::Node(const array& content) {
-        variant = new MArray(content);
+    Node::Node(object&& content) : base_type(OBJECT) {
+        object_value = create_collection(std::move(content));
     }
 
-    Node::Node(const object& content) {
-        variant = new MObject(content);
+    Node Node::borrow_string(std::string_view content) {
+        Node borrowed;
+        borrowed.base_type = STRING;
+        borrowed.string_borrowed = true;
+        borrowed.view_value = content;
+        return borrowed;
     }
 
+    // Both assignments build the new value before releasing the old one,
+    // so assigning a node from one of its own children is safe.
     Node& Node::operator=(const Node& other) {
         if (&other == this) {
             // dont overwrite with self, that will crash
             return *this;
         }
-        _copy_variant(other);
+        Node copy(other);
+        _move_variant(copy);
+        return *this;
+    }
+
+    Node& Node::operator=(Node&& other) noexcept {
+        if (&other == this) {
+            return *this;
+        }
+        Node taken(std::move(other));
+        _move_variant(taken);
         return *this;
     }
 
@@ -498,6 +1765,8 @@ namespace sjson {
     }
 
     void Node::set_type(const NodeType& t) {
+        if (t == base_type) return;
+
         switch (t)
         {
         case STRING:
@@ -520,100 +1789,300 @@ namespace sjson {
             break;
         }
     }
- 
-    Node::string Node::as_string() const {
-        return variant->as_string();
-    }
-
-    Node::string& Node::as_string_mut() {
-        return variant->as_string_mut();
-    }
 
-    const Node::string& Node::as_string_reference() const {
-        return variant->as_string_reference();
-    }
-
-    Node::real Node::as_real() const {
-        return variant->as_real();
+    //= STRING ===========================================
+    Node::string Node::as_string() const {
+        switch (base_type)
+        {
+        case STRING:
+            return string(as_string_view());
+        case INTEGER:
+            return std::to_string(int_value);
+        case REAL:
+            {
+                // shortest text that reads back as the same double
+                char text[32];
+                return string(text, std::to_chars(text, text + sizeof(text), real_value).ptr);
+            }
+        case ARRAY:
+            return _array_to_string(*array_value);
+        case OBJECT:
+            return _object_to_string(*object_value);
+        default:
+            throw coercion_invalid();
+        }
+    }
+
+    std::string_view Node::as_string_view() const {
+        if (base_type != STRING) throw wrong_type();
+        return (string_borrowed)? view_value : std::string_view(string_value);
+    }
+
+    Node::string& Node::as_string_mut() {
+        if (base_type != STRING) throw wrong_type();
+        if (string_borrowed) {
+            *this = Node(string(view_value));
+        }
+        return string_value;
+    }
+
+    const Node::string& Node::as_string_reference() const {
+        if (base_type != STRING || string_borrowed) throw wrong_type();
+        return string_value;
+    }
+
+    void Node::set_string(const string& content) {
+        *this = Node(content);
+    }
+
+    void Node::set_string(string&& content) {
+        *this = Node(std::move(content));
+    }
+
+    //= NUMBER ===========================================
+    Node::real Node::as_real() const {
+        switch (base_type)
+        {
+        case NONE:
+            return 0;
+        case INTEGER:
+            return static_cast<real>(int_value);
+        case REAL:
+            return real_value;
+        case STRING:
+            try {
+                return std::stod(as_string());
+            }
+            catch (std::invalid_argument& e) {
+                throw coercion_invalid();
+            }
+        default:
+            throw coercion_invalid();
+        }
     }
 
     Node::real& Node::as_real_mut() {
-        return variant->as_real_mut();
+        if (base_type != REAL) throw wrong_type();
+        return real_value;
     }
 
     Node::integer Node::as_int() const {
-        return variant->as_int();
+        switch (base_type)
+        {
+        case NONE:
+            return 0;
+        case INTEGER:
+            return int_value;
+        case REAL:
+            return static_cast<integer>(real_value);
+        case STRING:
+            try {
+                return std::stol(as_string());
+            }
+            catch(std::invalid_argument& e) {
+                throw coercion_invalid();
+            }
+        default:
+            throw coercion_invalid();
+        }
     }
 
     Node::integer& Node::as_int_mut() {
-        return variant->as_int_mut();
+        if (base_type != INTEGER) throw wrong_type();
+        return int_value;
+    }
+
+    void Node::set_number(real value) {
+        *this = Node(value);
+    }
+
+    void Node::set_number(integer value) {
+        *this = Node(value);
     }
 
+    //= ARRAY ============================================
     const Node::array Node::as_array() const {
-        return variant->as_array();
+        switch (base_type)
+        {
+        case INTEGER:
+            return {int_value};
+        case REAL:
+            return {real_value};
+        case ARRAY:
+            return *array_value;
+        default:
+            throw coercion_invalid();
+        }
     }
 
     Node::array& Node::as_array_mut() {
-        return variant->as_array_mut();
+        if (base_type != ARRAY) throw wrong_type();
+        return *array_value;
     }
 
     const Node::array& Node::as_array_reference() const {
-        return variant->as_array_reference();
+        if (base_type != ARRAY) throw wrong_type();
+        return *array_value;
+    }
+
+    void Node::set_array(const array& content) {
+        *this = Node(content);
+    }
+
+    void Node::set_array(array&& content) {
+        *this = Node(std::move(content));
     }
 
+    //= OBJECT ===========================================
     const object Node::as_object() const {
-        return variant->as_object();
+        if (base_type != OBJECT) throw coercion_invalid();
+        return *object_value;
     }
 
     Node::object& Node::as_object_mut() {
-        return variant->as_object_mut();
+        if (base_type != OBJECT) throw wrong_type();
+        return *object_value;
     }
 
     const Node::object& Node::as_object_reference() const {
-        return variant->as_object_reference();
+        if (base_type != OBJECT) throw wrong_type();
+        return *object_value;
+    }
+
+    void Node::set_object(const object& content) {
+        *this = Node(content);
+    }
+
+    void Node::set_object(object&& content) {
+        *this = Node(std::move(content));
+    }
+
+    std::size_t Node::memory_usage() const {
+        // what std::string holds without allocating
+        static const std::size_t inline_capacity = string().capacity();
+
+        std::size_t total = 0;
+        switch (base_type)
+        {
+        case STRING:
+            if (!string_borrowed && string_value.capacity() > inline_capacity) total = string_value.capacity() + 1;
+            break;
+        case ARRAY:
+            total = sizeof(array) + array_value->capacity() * sizeof(Node);
+            for (const Node& element : *array_value) total += element.memory_usage();
+            break;
+        case OBJECT:
+            total = sizeof(object) + object_value->memory_usage();
+            for (const object::value_type& member : *object_value) total += member.second.memory_usage();
+            break;
+        default:
+            break;
+        }
+        return total;
     }
 
+    //==================================================
     void Node::_destroy_variant() {
-         delete variant;
-        variant = nullptr;
+        switch (base_type)
+        {
+        case STRING:
+            if (!string_borrowed) string_value.~string();
+            break;
+        case ARRAY:
+            destroy_collection(array_value);
+            break;
+        case OBJECT:
+            destroy_collection(object_value);
+            break;
+        default:
+            break;
+        }
+        base_type = NONE;
+        string_borrowed = false;
+        int_value = 0;
     }
 
     void Node::_copy_variant(const Node& base) {
-        if (variant != nullptr) _destroy_variant();
-        
-        switch (base.get_type())
+        _destroy_variant();
+
+        switch (base.base_type)
+        {
+        case NONE:
+            break;
+
+        case INTEGER:
+            int_value = base.int_value;
+            break;
+
+        case REAL:
+            real_value = base.real_value;
+            break;
+
+        case STRING:
+            // copies own their string, even when the original was borrowed
+            new (&string_value) string(base.as_string_view());
+            break;
+
+        case ARRAY:
+            COUNT_DEEP_COPY();
+            array_value = create_collection(array(*base.array_value));
+            break;
+
+        case OBJECT:
+            COUNT_DEEP_COPY();
+            object_value = create_collection(object(*base.object_value));
+            break;
+        }
+        base_type = base.base_type;
+    }
+
+    void Node::_move_variant(Node& base) noexcept {
+        _destroy_variant();
+
+        switch (base.base_type)
         {
         case NONE:
-            variant = new Mnull();
             break;
 
         case INTEGER:
-            variant = new MInt(base.as_int());
+            int_value = base.int_value;
             break;
 
         case REAL:
-            variant = new MReal(base.as_real());
+            real_value = base.real_value;
             break;
 
         case STRING:
-            variant = new MString(base.as_string_reference());
+            if (base.string_borrowed) {
+                view_value = base.view_value;
+                string_borrowed = true;
+            }
+            else {
+                new (&string_value) string(std::move(base.string_value));
+                base.string_value.~string();
+            }
             break;
 
         case ARRAY:
-            variant = new MArray(base.as_array_reference());
+            array_value = base.array_value;
             break;
 
         case OBJECT:
-            variant = new MObject(base.as_object_reference());
+            object_value = base.object_value;
             break;
         }
+        base_type = base.base_type;
+
+        base.base_type = NONE;
+        base.string_borrowed = false;
+        base.int_value = 0;
     }
 
     Node::string Node::_to_string() const {
         return as_string();
     }
 
-    Node::string Node::_object_to_string(object e) {
+    Node::string Node::_object_to_string(const object& e) {
         std::stringstream stream;
         stream << "Object:{";
         for (const auto& pair:e) {
@@ -624,7 +2093,7 @@ namespace sjson {
         return stream.str();
     }
     
-    Node::string Node::_array_to_string(array a) {
+    Node::string Node::_array_to_string(const array& a) {
         std::stringstream stream;
         stream << "[";
         for (const Node& node : a) {
@@ -634,6 +2103,297 @@ namespace sjson {
         return stream.str();
     }
 
+    //= KEYS =============================================
+    std::ostream& operator<<(std::ostream& stream, const Key& key) {
+        return stream << key.view();
+    }
+
+    KeyTable::KeyTable(std::size_t max) : max_keys(max) {
+        slots.assign(64, Key(nullptr, 0, false, 0));
+    }
+
+    std::size_t KeyTable::probe(std::string_view text, uint32_t hash) const {
+        const std::size_t mask = slots.size() - 1;
+        for (std::size_t slot = hash & mask; ; slot = (slot + 1) & mask) {
+            const Key& key = slots[slot];
+            if (key.text == nullptr) return slot;
+            if (key.hash_value == hash && key.view() == text) return slot;
+        }
+    }
+
+    void KeyTable::grow() {
+        std::vector<Key> old(slots.size() * 2, Key(nullptr, 0, false, 0));
+        old.swap(slots);
+        for (const Key& key : old) {
+            if (key.text != nullptr) slots[probe(key.view(), key.hash_value)] = key;
+        }
+    }
+
+    Key KeyTable::intern(std::string_view text) {
+        // checked before anything is hashed or copied
+        const uint32_t length = Key::checked_length(text);
+        const uint32_t hash = hash_key_text(text);
+        const Key uninterned(text.data(), length, false, hash);
+
+        // almost every key is already in the table, so look under the shared lock first
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            const Key& found = slots[probe(text, hash)];
+            if (found.text != nullptr) return found;
+            if (count >= max_keys) return uninterned;
+        }
+
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        const std::size_t slot = probe(text, hash);
+        if (slots[slot].text != nullptr) return slots[slot];
+        if (count >= max_keys) return uninterned;
+
+        char* copy = static_cast<char*>(text_pool.allocate(std::max<std::size_t>(text.size(), 1), 1));
+        std::memcpy(copy, text.data(), text.size());
+        const Key interned(copy, length, true, hash);
+        slots[slot] = interned;
+        count++;
+        if (count * 2 > slots.size()) grow();
+        return interned;
+    }
+
+    Key KeyTable::find(std::string_view text) const {
+        const uint32_t length = Key::checked_length(text);
+        const uint32_t hash = hash_key_text(text);
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        const Key& found = slots[probe(text, hash)];
+        if (found.text != nullptr) return found;
+        return Key(text.data(), length, false, hash);
+    }
+
+    std::size_t KeyTable::size() const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return count;
+    }
+
+    //= OBJECT MAP =======================================
+    ObjectMap::ObjectMap() {}
+
+    ObjectMap::ObjectMap(const allocator_type& alloc) : entries(alloc), index(alloc), key_bytes(alloc) {}
+
+    ObjectMap::ObjectMap(std::initializer_list<value_type> members, const allocator_type& alloc)
+        : entries(alloc), index(alloc), key_bytes(alloc) {
+        entries.reserve(members.size());
+        for (const value_type& member : members) {
+            insert(member);
+        }
+    }
+
+    ObjectMap::ObjectMap(const ObjectMap& other) {
+        entries.reserve(other.entries.size());
+        std::size_t text_size = 0;
+        for (const value_type& member : other.entries) text_size += member.first.size();
+        key_bytes.reserve(text_size);
+
+        for (const value_type& member : other.entries) {
+            const Key& key = member.first;
+            entries.emplace_back(store_key(Key(key.text, key.length, false, key.hash_value)), member.second);
+        }
+        index = other.index;
+    }
+
+    ObjectMap::ObjectMap(ObjectMap&& other) noexcept
+        : entries(std::move(other.entries)), index(std::move(other.index)), key_bytes(std::move(other.key_bytes)) {}
+
+    ObjectMap& ObjectMap::operator=(const ObjectMap& other) {
+        if (&other == this) return *this;
+        ObjectMap copy(other);
+        return *this = std::move(copy);
+    }
+
+    ObjectMap& ObjectMap::operator=(ObjectMap&& other) {
+        if (&other == this) return *this;
+        if (get_allocator() != other.get_allocator()) {
+            // the buffers can't be stolen, so key text has to be copied and re-pointed
+            clear();
+            entries.reserve(other.entries.size());
+            for (value_type& member : other.entries) {
+                entries.emplace_back(store_key(member.first), std::move(member.second));
+            }
+            index = other.index;
+            return *this;
+        }
+        entries = std::move(other.entries);
+        index = std::move(other.index);
+        key_bytes = std::move(other.key_bytes);
+        return *this;
+    }
+
+    ObjectMap::allocator_type ObjectMap::get_allocator() const {
+        return entries.get_allocator();
+    }
+
+    ObjectMap::iterator ObjectMap::begin() {
+        return entries.begin();
+    }
+
+    ObjectMap::iterator ObjectMap::end() {
+        return entries.end();
+    }
+
+    ObjectMap::const_iterator ObjectMap::begin() const {
+        return entries.begin();
+    }
+
+    ObjectMap::const_iterator ObjectMap::end() const {
+        return entries.end();
+    }
+
+    std::size_t ObjectMap::size() const {
+        return entries.size();
+    }
+
+    bool ObjectMap::empty() const {
+        return entries.empty();
+    }
+
+    Key ObjectMap::store_key(const Key& key) {
+        if (key.is_interned()) return key;
+        if (key.size() == 0) return Key();
+
+        const char* old_base = key_bytes.data();
+        const std::size_t offset = key_bytes.size();
+        if (offset + key.size() > key_bytes.capacity()) {
+            key_bytes.reserve(std::max(key_bytes.capacity() * 2, offset + key.size()));
+        }
+        key_bytes.insert(key_bytes.end(), key.data(), key.data() + key.size());
+
+        // the buffer moved, point the stored keys at the new one
+        const char* new_base = key_bytes.data();
+        if (new_base != old_base && old_base != nullptr) {
+            for (value_type& member : entries) {
+                if (!member.first.is_interned()) member.first.text = new_base + (member.first.text - old_base);
+            }
+        }
+        return Key(new_base + offset, key.length, false, key.hash_value);
+    }
+
+    std::size_t ObjectMap::find_position(const Key& key) const {
+        if (index.empty()) {
+            for (std::size_t i = 0; i < entries.size(); i++) {
+                if (entries[i].first == key) return i;
+            }
+            return entries.size();
+        }
+
+        const uint32_t hash = key.hash();
+        const std::size_t mask = index.size() - 1;
+        for (std::size_t slot = hash & mask; ; slot = (slot + 1) & mask) {
+            const Slot& s = index[slot];
+            if (s.entry == EMPTY_SLOT) return entries.size();
+            if (s.hash == hash && entries[s.entry].first == key) return s.entry;
+        }
+    }
+
+    void ObjectMap::rebuild_index() {
+        if (entries.size() <= INDEX_THRESHOLD) {
+            index.clear();
+            return;
+        }
+
+        // keep the load factor at or under a half
+        std::size_t capacity = 16;
+        while (capacity < entries.size() * 4) capacity *= 2;
+
+        index.assign(capacity, Slot{EMPTY_SLOT, 0});
+        const std::size_t mask = capacity - 1;
+        for (std::size_t i = 0; i < entries.size(); i++) {
+            const uint32_t hash = entries[i].first.hash();
+            std::size_t slot = hash & mask;
+            while (index[slot].entry != EMPTY_SLOT) slot = (slot + 1) & mask;
+            index[slot] = Slot{static_cast<uint32_t>(i), hash};
+        }
+    }
+
+    ObjectMap::iterator ObjectMap::find(const Key& key) {
+        return entries.begin() + find_position(key);
+    }
+
+    ObjectMap::const_iterator ObjectMap::find(const Key& key) const {
+        return entries.begin() + find_position(key);
+    }
+
+    std::size_t ObjectMap::count(const Key& key) const {
+        return (find_position(key) < entries.size())? 1 : 0;
+    }
+
+    Node& ObjectMap::at(const Key& key) {
+        const std::size_t position = find_position(key);
+        if (position >= entries.size()) throw std::out_of_range("ObjectMap::at");
+        return entries[position].second;
+    }
+
+    const Node& ObjectMap::at(const Key& key) const {
+        const std::size_t position = find_position(key);
+        if (position >= entries.size()) throw std::out_of_range("ObjectMap::at");
+        return entries[position].second;
+    }
+
+    Node& ObjectMap::operator[](const Key& key) {
+        return emplace(key, Node()).first->second;
+    }
+
+    std::pair<ObjectMap::iterator, bool> ObjectMap::emplace(const Key& key, Node&& value) {
+        if (index.empty()) {
+            const std::size_t position = find_position(key);
+            if (position < entries.size()) return {entries.begin() + position, false};
+
+            const Key stored = store_key(key);
+            entries.emplace_back(stored, std::move(value));
+            if (entries.size() > INDEX_THRESHOLD) rebuild_index();
+            return {entries.end() - 1, true};
+        }
+
+        // the probe that looks for the key also finds the slot to insert into
+        const uint32_t hash = key.hash();
+        const std::size_t mask = index.size() - 1;
+        std::size_t slot = hash & mask;
+        for (; index[slot].entry != EMPTY_SLOT; slot = (slot + 1) & mask) {
+            const Slot& s = index[slot];
+            if (s.hash == hash && entries[s.entry].first == key) return {entries.begin() + s.entry, false};
+        }
+
+        const Key stored = store_key(key);
+        entries.emplace_back(stored, std::move(value));
+        index[slot] = Slot{static_cast<uint32_t>(entries.size() - 1), hash};
+        if (entries.size() * 2 > index.size()) rebuild_index();
+        return {entries.end() - 1, true};
+    }
+
+    std::pair<ObjectMap::iterator, bool> ObjectMap::insert(const value_type& member) {
+        return emplace(member.first, Node(member.second));
+    }
+
+    std::size_t ObjectMap::erase(const Key& key) {
+        const std::size_t position = find_position(key);
+        if (position >= entries.size()) return 0;
+
+        // the erased key's text stays in key_bytes until the map is copied
+        entries.erase(entries.begin() + position);
+        // positions after the erased member have all shifted
+        rebuild_index();
+        return 1;
+    }
+
+    void ObjectMap::clear() {
+        entries.clear();
+        index.clear();
+        key_bytes.clear();
+    }
+
+    void ObjectMap::reserve(std::size_t members) {
+        entries.reserve(members);
+    }
+
+    std::size_t ObjectMap::memory_usage() const {
+        return entries.capacity() * sizeof(value_type) + index.capacity() * sizeof(Slot) + key_bytes.capacity();
+    }
+
     //todo: test this
     
 
@@ -681,79 +2441,244 @@ namespace sjson {
         static constexpr char NEGATIVE = '-';
         static constexpr char JSON_NULL[] = "null";
 
-        void write_as_json_recurse(const Node& node, int layer, std::ostream& stream, bool has_label = false, std::string label = "") {
+        //= WRITER ===========================================
+        void StreamSink::write(const char* data, std::size_t length) {
+            stream.write(data, length);
+        }
 
-        stream << std::string( layer, '\t' );
+        JsonWriter::JsonWriter(const JsonFormat& format, JsonSink* sink) : format(format), sink(sink) {
+            buffer.resize((sink)? BLOCK_SIZE : 4096);
+            indent_text.assign(1 + 16 * format.indent_width, format.indent_char);
+            indent_text[0] = '\n';
+        }
 
-        if (has_label) {
-            stream << QUOTE_OPEN << label << QUOTE_CLOSE << NAME_SPECIFIER;
+        char* JsonWriter::make_room(std::size_t bytes) {
+            if (used + bytes > buffer.size()) {
+                // with a sink the block is flushed rather than grown
+                if (sink != nullptr) flush();
+                if (used + bytes > buffer.size()) {
+                    buffer.resize(std::max(buffer.size() * 2, used + bytes));
+                }
+            }
+            return &buffer[used];
         }
 
-        switch (node.get_type())
-        {
-        case REAL:
-            stream << node.as_real();
-            break;
+        void JsonWriter::append(const char* data, std::size_t length) {
+            // an empty borrowed string can have a null data pointer, which memcpy mustn't see
+            if (length == 0) return;
+            std::memcpy(make_room(length), data, length);
+            used += length;
+        }
 
-        case INTEGER:
-            stream << node.as_int();
-            break;
-        
-        case STRING:
-            stream << QUOTE_OPEN << node.as_string() << QUOTE_CLOSE;
-            break;
-        
-        case NONE:
-            stream << JSON_NULL;
-            break;
+        void JsonWriter::put(char c) {
+            *make_room(1) = c;
+            used++;
+        }
 
-        case ARRAY:
-            {
-                stream << ARRAY_OPEN << '\n';
+        void JsonWriter::new_line() {
+            const std::size_t length = 1 + depth * format.indent_width;
+            if (length > indent_text.size()) {
+                indent_text.resize(std::max(indent_text.size() * 2, length), format.indent_char);
+            }
+            append(indent_text.data(), length);
+        }
 
-                unsigned int line_number = 0;
-                const Node::array& ref = node.as_array_reference();
-                for (const Node& c : ref) {
-                    write_as_json_recurse(c, layer + 1, stream);
+        // commas and indentation go in front of values, so nothing has to be undone at a close
+        void JsonWriter::before_value() {
+            if (after_key) {
+                after_key = false;
+                return;
+            }
+            if (depth > 0) {
+                if (!first_in_container) put(END_PHRASE);
+                if (format.pretty) new_line();
+            }
+            first_in_container = false;
+        }
 
-                    if ( (line_number++) < ref.size() ) stream << END_PHRASE << '\n';
-                    else stream << '\n';
-                    
+        void JsonWriter::write_escaped(std::string_view text) {
+            put(QUOTE_OPEN);
+            const char* p = text.data();
+            const char* end = text.data() + text.size();
+            while (true) {
+                // clean runs are found a vector at a time and copied in one go
+                const std::size_t clean = find_escape(p, end - p, simd);
+                append(p, clean);
+                p += clean;
+                if (p == end) break;
+
+                const unsigned char c = *(p++);
+
+                char escaped[6] = {ESCAPE, 0, 0, 0, 0, 0};
+                switch (c)
+                {
+                case '"': escaped[1] = '"'; break;
+                case '\\': escaped[1] = '\\'; break;
+                case '\b': escaped[1] = 'b'; break;
+                case '\f': escaped[1] = 'f'; break;
+                case '\n': escaped[1] = 'n'; break;
+                case '\r': escaped[1] = 'r'; break;
+                case '\t': escaped[1] = 't'; break;
+                default:
+                    {
+                        static constexpr char HEX[] = "0123456789abcdef";
+                        escaped[1] = 'u';
+                        escaped[2] = '0';
+                        escaped[3] = '0';
+                        escaped[4] = HEX[c >> 4];
+                        escaped[5] = HEX[c & 0xf];
+                        append(escaped, 6);
+                        continue;
+                    }
                 }
-
-                stream << std::string( layer, '\t' ) << ARRAY_CLOSE;
-
+                append(escaped, 2);
             }
-            break;
+            put(QUOTE_CLOSE);
+        }
 
-        case OBJECT:
-            {
-                stream << OBJECT_OPEN << '\n';
-                unsigned int line_number = 0;
-                const Node::object& ref = node.as_object_reference();
+        void JsonWriter::start_object() {
+            before_value();
+            put(OBJECT_OPEN);
+            depth++;
+            first_in_container = true;
+        }
 
-                for (const auto& pair : ref) {
-                    write_as_json_recurse(pair.second, layer + 1, stream, true, pair.first);
-                    if ( (line_number++) < ref.size() ) stream << ",\n";
-                    else stream << '\n';
+        void JsonWriter::end_object() {
+            depth--;
+            if (format.pretty && !first_in_container) new_line();
+            put(OBJECT_CLOSE);
+            first_in_container = false;
+        }
+
+        void JsonWriter::start_array() {
+            before_value();
+            put(ARRAY_OPEN);
+            depth++;
+            first_in_container = true;
+        }
+
+        void JsonWriter::end_array() {
+            depth--;
+            if (format.pretty && !first_in_container) new_line();
+            put(ARRAY_CLOSE);
+            first_in_container = false;
+        }
+
+        void JsonWriter::key(std::string_view text) {
+            before_value();
+            write_escaped(text);
+            put(NAME_SPECIFIER);
+            if (format.pretty) put(' ');
+            after_key = true;
+        }
+
+        void JsonWriter::string(std::string_view text) {
+            before_value();
+            write_escaped(text);
+        }
+
+        void JsonWriter::integer(Node::integer value) {
+            before_value();
+            char* out = make_room(24);
+            used += std::to_chars(out, out + 24, value).ptr - out;
+        }
+
+        void JsonWriter::real(Node::real value) {
+            if (!std::isfinite(value)) {
+                null();
+                return;
+            }
+            before_value();
+            // the shortest digits that read back as the same double
+            char* out = make_room(32);
+            char* end = std::to_chars(out, out + 32, value).ptr;
+            // keep whole reals reading back as reals
+            if (std::find_if(out, end, [](char c) { return c == DECIMAL || c == SCIENTIFIC_NOTATION_LOWER; }) == end) {
+                *(end++) = DECIMAL;
+                *(end++) = '0';
+            }
+            used += end - out;
+        }
+
+        void JsonWriter::boolean(bool value) {
+            before_value();
+            if (value) append("true", 4);
+            else append("false", 5);
+        }
+
+        void JsonWriter::null() {
+            before_value();
+            append(JSON_NULL, sizeof(JSON_NULL) - 1);
+        }
+
+        void JsonWriter::write(const Node& node) {
+            switch (node.get_type())
+            {
+            case NONE:
+                null();
+                break;
+            case STRING:
+                string(node.as_string_view());
+                break;
+            case INTEGER:
+                integer(node.as_int());
+                break;
+            case REAL:
+                real(node.as_real());
+                break;
+            case ARRAY:
+                start_array();
+                for (const Node& element : node.as_array_reference()) {
+                    write(element);
+                }
+                end_array();
+                break;
+            case OBJECT:
+                start_object();
+                for (const auto& member : node.as_object_reference()) {
+                    key(member.first);
+                    write(member.second);
                 }
-                stream << std::string( layer, '\t' ) << OBJECT_CLOSE;
+                end_object();
+                break;
             }
+        }
 
-        default:
-            break;
+        void JsonWriter::flush() {
+            if (sink != nullptr && used > 0) {
+                sink->write(buffer.data(), used);
+                used = 0;
+            }
         }
-    }
 
-    void write_node_as_json(const Node& node, std::ostream& stream) {
-        write_as_json_recurse(node, 0, stream);
-    }
+        std::string_view JsonWriter::output() const {
+            return std::string_view(buffer.data(), used);
+        }
 
-    Node::string node_to_json_string(const Node& n) {
-        std::stringstream stream("");
-        write_node_as_json(n,stream);
-        return stream.str();
-    }
+        std::string JsonWriter::take_output() {
+            buffer.resize(used);
+            used = 0;
+            return std::move(buffer);
+        }
+
+        void write_node_as_json(const Node& node, std::ostream& stream, const JsonFormat& format) {
+            StreamSink sink(stream);
+            JsonWriter writer(format, &sink);
+            writer.write(node);
+            writer.flush();
+        }
+
+        Node::string node_to_json_string(const Node& node, const JsonFormat& format) {
+            JsonWriter writer(format);
+            writer.write(node);
+            return writer.take_output();
+        }
+
+        void write_node_to_file(const Node& node, const std::string& path, const JsonFormat& format) {
+            std::ofstream stream(path, std::ios::binary);
+            if (!stream) throw std::ios_base::failure("can't open " + path);
+            write_node_as_json(node, stream, format);
+        }
 
         bool json_is_numeric_char(const char& c) {
             switch (c)
@@ -804,7 +2729,6 @@ namespace sjson {
                     }
                     else {
                         // I don't know of any other way to break out of this if branch
-                        DEBUG_PRINT("Non numeric character (" << c << "), interpreting as string.");
                         goto NON_NUMERIC;
                     }
                 }
@@ -815,23 +2739,144 @@ namespace sjson {
             return NONE;
         }
 
-        Node parse_str_to_node(const std::string& str) {
-            NodeType type = detect_node_type_str(str);
-            Node a(str);
-            if (type == STRING) {
-                a.as_string_mut() = a.as_string_reference().substr(1);
-                return a;
+        //= NUMBERS ==========================================
+        // every power of ten a double holds exactly
+        static constexpr double EXACT_POWERS_OF_TEN[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+        };
+
+        bool json_is_digit(char c) {
+            return c >= '0' && c <= '9';
+        }
+
+        NodeType parse_number(const char* begin, const char* end, Node::integer& int_value, Node::real& real_value) {
+            const char* p = begin;
+            const bool negative = p < end && *p == NEGATIVE;
+            if (negative) p++;
+            if (p >= end || !json_is_digit(*p)) {
+                if (negative) throw json::invalid_number();
+                return NONE;
             }
-            
-            try {
-                a.set_type(detect_node_type_str(str));
+
+            // Up to 19 significant digits fit a uint64 exactly. Past that the
+            // digits are only counted, and the slow path below rounds properly.
+            uint64_t mantissa = 0;
+            int digits = 0;
+            int64_t exponent = 0;
+            bool truncated = false;
+            bool is_real = false;
+
+            if (*p == '0') {
+                p++;
+                if (p < end && json_is_digit(*p)) throw json::invalid_number();
             }
-            catch (Node::coercion_invalid& e) {
-                // should throw or something.
-                // just interperet as an str for now
+            while (p < end && json_is_digit(*p)) {
+                if (digits < 19) {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    digits++;
+                }
+                else {
+                    exponent++;
+                    truncated = true;
+                }
+                p++;
             }
-            
-            return a;
+
+            if (p < end && *p == DECIMAL) {
+                is_real = true;
+                p++;
+                if (p >= end || !json_is_digit(*p)) throw json::invalid_number();
+                for (; p < end && json_is_digit(*p); p++) {
+                    if (digits >= 19) {
+                        truncated = true;
+                        continue;
+                    }
+                    // zeros before the first significant digit only shift the exponent
+                    if (mantissa != 0 || *p != '0') {
+                        mantissa = mantissa * 10 + (*p - '0');
+                        digits++;
+                    }
+                    exponent--;
+                }
+            }
+
+            if (p < end && (*p == SCIENTIFIC_NOTATION_LOWER || *p == SCIENTIFIC_NOTATION_UPPPER)) {
+                is_real = true;
+                p++;
+                bool exponent_negative = false;
+                if (p < end && (*p == POSITIVE || *p == NEGATIVE)) {
+                    exponent_negative = *p == NEGATIVE;
+                    p++;
+                }
+                if (p >= end || !json_is_digit(*p)) throw json::invalid_number();
+                int64_t written = 0;
+                for (; p < end && json_is_digit(*p); p++) {
+                    // anything this big is already infinity or zero
+                    if (written < 100000) written = written * 10 + (*p - '0');
+                }
+                exponent += (exponent_negative)? -written : written;
+            }
+
+            if (p != end) throw json::invalid_number();
+
+            if (!is_real && !truncated) {
+                constexpr uint64_t max = std::numeric_limits<Node::integer>::max();
+                if (!negative && mantissa <= max) {
+                    int_value = static_cast<Node::integer>(mantissa);
+                    return INTEGER;
+                }
+                if (negative && mantissa <= max + 1) {
+                    int_value = (mantissa == max + 1)? std::numeric_limits<Node::integer>::min() : -static_cast<Node::integer>(mantissa);
+                    return INTEGER;
+                }
+                // integers that overflow are kept as reals
+            }
+
+            // Clinger's fast path, exact because both operands are exact doubles
+            if (!truncated && mantissa <= (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22) {
+                double value = static_cast<double>(mantissa);
+                value = (exponent < 0)? value / EXACT_POWERS_OF_TEN[-exponent] : value * EXACT_POWERS_OF_TEN[exponent];
+                real_value = (negative)? -value : value;
+                return REAL;
+            }
+
+            double value = 0;
+            const std::from_chars_result result = std::from_chars(begin, end, value);
+            if (result.ec == std::errc::result_out_of_range) {
+                value = (exponent > 0)? std::numeric_limits<double>::infinity() : 0.0;
+                if (negative) value = -value;
+            }
+            real_value = value;
+            return REAL;
+        }
+
+        // A bare token as a node: numbers, true and false as 1 and 0, and
+        // anything else as null.
+        Node bare_to_node(const char* begin, const char* end) {
+            Node::integer int_value;
+            Node::real real_value;
+            switch (parse_number(begin, end, int_value, real_value))
+            {
+            case INTEGER:
+                return Node(int_value);
+            case REAL:
+                return Node(real_value);
+            default:
+                break;
+            }
+
+            const std::string_view text(begin, end - begin);
+            if (text == "true") return Node(Node::integer(1));
+            if (text == "false") return Node(Node::integer(0));
+            return Node();
+        }
+
+        Node parse_str_to_node(const std::string& str) {
+            if (!str.empty() && str[0] == QUOTE_OPEN) {
+                return Node(str.substr(1));
+            }
+            return bare_to_node(str.data(), str.data() + str.size());
         }
 
         char escape_to_raw(const char& code) {
@@ -851,6 +2896,8 @@ namespace sjson {
                 return '"';
             case '\\':
                 return '\\';
+            case '/':
+                return '/';
             default:
                 return '?';
                 break;
@@ -932,333 +2979,2706 @@ namespace sjson {
             return collect.str();
         }
 
-        Node parse_from_istream(std::istream& stream) {
+        // json only counts these four as whitespace
+        bool json_is_space(const char& c) {
+            return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+        }
 
-            class ParseHelper {
-                public:
-                    void parse_token(const std::string& token) {
-
-                        DEBUG_PRINT("Token: " << token);
-
-                        if (token.length() == 1) {
-                            const char c = token[0];
-
-                            switch (c)
-                            {
-                            case OBJECT_OPEN:
-                                push_object();
-                                return;
-                            case OBJECT_CLOSE:
-                                if (!top_is_object()) throw json::wrong_closer();
-                                pop();
-                                return;
-                            
-                            case ARRAY_OPEN:
-                                push_array();
-                                return;
-                            case ARRAY_CLOSE:
-                                if (!top_is_array()) throw json::wrong_closer();
-                                pop();
-                                return;
-
-                            case NAME_SPECIFIER:
-                                current.set_label_as_node();
-                                return;
-                            
-                            case END_PHRASE:
-                                append_to_top(current);
-                                current = StatementBuilder();
-                                return;
-
-                            default:
-                                break;
-                            }
-                        }
-                        
-                        // must be definition
-                        if (current.is_node_assigned()) {
-                            throw json::missing_delimeter();
-                        }
+        BufferTokenizer::BufferTokenizer(const char* d, std::size_t l) : data(d), length(l) {}
 
+        std::size_t BufferTokenizer::position() const {
+            return cursor;
+        }
 
-                        Node derived = parse_str_to_node(token);
-                        current.set_node(derived);
-                        
-                    }
+        bool BufferTokenizer::next(Token& token) {
+            while (cursor < length && json_is_space(data[cursor])) cursor++;
 
-                    bool done() const {
-                        return _done;
-                    }
+            token = Token();
+            if (cursor >= length) {
+                token.begin = token.end = length;
+                return false;
+            }
 
-                    Node get_root() const {
-                        if (done()) {
-                            return root;
-                        }
-                        else {
-                            DEBUG_PRINT( __LINE__ << ": STACK NOT EMPTY!!!" );
-                            assert(false);
-                            return root;
+            token.begin = cursor;
+            switch (data[cursor])
+            {
+            case OBJECT_OPEN:
+                token.kind = TOKEN_OBJECT_OPEN;
+                break;
+            case OBJECT_CLOSE:
+                token.kind = TOKEN_OBJECT_CLOSE;
+                break;
+            case ARRAY_OPEN:
+                token.kind = TOKEN_ARRAY_OPEN;
+                break;
+            case ARRAY_CLOSE:
+                token.kind = TOKEN_ARRAY_CLOSE;
+                break;
+            case NAME_SPECIFIER:
+                token.kind = TOKEN_NAME_SPECIFIER;
+                break;
+            case END_PHRASE:
+                token.kind = TOKEN_END_PHRASE;
+                break;
+
+            case QUOTE_OPEN:
+                {
+                    token.kind = TOKEN_STRING;
+                    const std::size_t start = cursor + 1;
+                    token.begin = start;
+
+                    // Most strings have no escapes, so find the closing quote with
+                    // memchr and only walk byte by byte if a backslash shows up.
+                    const char* quote = static_cast<const char*>(std::memchr(data + start, QUOTE_CLOSE, length - start));
+                    if (quote == nullptr) throw json::unterminated_string();
+
+                    std::size_t i = quote - data;
+                    if (std::memchr(data + start, ESCAPE, i - start) != nullptr) {
+                        token.escaped = true;
+                        i = start;
+                        while (true) {
+                            if (i >= length) throw json::unterminated_string();
+                            if (data[i] == QUOTE_CLOSE) break;
+                            i += (data[i] == ESCAPE)? 2 : 1;
                         }
                     }
 
-                private:
+                    token.end = i;
+                    cursor = i + 1;
+                    return true;
+                }
 
-                    // Class represents partial statements
-                    class StatementBuilder {
-                        public:
-
-                            class no_label : public std::exception {};
-                            class no_token : public std::exception {};
-
-                            bool is_label_assigned() const {
-                                return label_assigned;
-                            }
-                            void set_label(const Node::string base) {
-                                label = base;
-                                label_assigned = true;
-                            }
-                            const Node::string& get_label() const {
-                                if (label_assigned) {
-                                    return label;
-                                }
-                                else {
-                                    throw no_label();
-                                }
-                            }
-
-                            bool is_node_assigned() const {
-                                return token_assigned;
-                            }
-                            void set_node(const Node base) {
-                                token = base;
-                                token_assigned = true;
-                            }
-                            Node& get_node_mut() {
-                                if (token_assigned) {
-                                    return token;
-                                }
-                                else {
-                                    throw no_token();
-                                }
-                            }
-                            const Node& get_node() const {
-                                if (token_assigned) {
-                                    return token;
-                                }
-                                else {
-                                    throw no_token();
-                                }
-                            }
-
-                            void set_label_as_node() {
-                                if (token.get_type() == STRING) {
-                                    set_label(token.as_string_reference());
-                                    token = Node();
-                                    token_assigned = false;
-                                }
-                                else {
-                                    //throw
-                                }
-                            }
-                        private:
-                            Node::string label;
-                            bool label_assigned = false;
-
-                            Node token;
-                            bool token_assigned = false;
-                    };
-
-                    bool top_is_array() {
-                        return top_type() == ARRAY;
-                    }
+            default:
+                {
+                    token.kind = TOKEN_BARE;
+                    std::size_t i = cursor + 1;
+                    while (i < length && !json_is_space(data[i]) && !json_is_delimeter(data[i]) && data[i] != QUOTE_OPEN) i++;
+                    token.end = i;
+                    cursor = i;
+                    return true;
+                }
+            }
 
-                    bool top_is_object() {
-                        return top_type() == OBJECT;
-                    }
+            token.end = ++cursor;
+            return true;
+        }
 
-                    void push_array() {
-                        Node dummy = Node(Node::array());
-                        current.set_node(dummy);
-                        push_current();
-                    }
+        //= CHUNK TOKENIZER ==================================
+        bool json_ends_bare(char c) {
+            return json_is_space(c) || json_is_delimeter(c) || c == QUOTE_OPEN;
+        }
 
-                    void push_object() {
-                        Node dummy = Node(Node::object());
-                        current.set_node(dummy);
-                        push_current();
-                    }
+        void ChunkTokenizer::start_chunk(const char* d, std::size_t l) {
+            if (max_bytes > 0 && l > max_bytes - consumed) throw json::too_many_bytes();
+            if (validate_utf8) utf8.feed(d, l, consumed);
+            consumed += l;
+            data = d;
+            length = l;
+            cursor = 0;
+        }
 
-                    void push_current() {
-                        nest_stack.push(current);
-                        current = StatementBuilder();
+        bool ChunkTokenizer::complete_partial() {
+            const std::size_t start = cursor;
+            bool ended = false;
+            if (partial_kind == TOKEN_STRING) {
+                while (cursor < length) {
+                    const char c = data[cursor++];
+                    if (partial_escape) {
+                        partial_escape = false;
                     }
-
-                    void pop() {
-                        if (current.is_node_assigned()) {
-                            append_to_top(current);
-                        }
-                        #if !JSON_ALLOW_TRAILING_COMMA
-                        else {
-                            throw json::trailing_comma();
-                        }
-                        #endif
-                        StatementBuilder popped = top();
-                        nest_stack.pop();
-                        if (nest_stack.size() == 0) {
-                            root = popped.get_node();
-                            _done = true;
-                            return;
-                        }
-                        else {
-                            current = popped;
-                        }
-                        
-                        //append_to_top(popped);
+                    else if (c == ESCAPE) {
+                        partial_escape = partial_escaped = true;
                     }
-
-                    void append_to_top(const StatementBuilder& st) {
-                        if (top_is_object()) {
-                            try {
-                                const Node::string label = st.get_label();
-                                Node::object& map = top_mut().get_node_mut().as_object_mut();
-                                if (map.count(label) > 0) throw json::duplicate_label();
-                                map[label] = st.get_node();
-                            }
-                            catch (StatementBuilder::no_label& e) {
-                                throw json::missing_label();
-                            }
-                        }
-                        else if (top_is_array()) {
-                            if (st.is_label_assigned()) {
-                                throw json::label_in_array();
-                            }
-                            try {
-                                Node::array& array = top_mut().get_node_mut().as_array_mut();
-                                array.push_back(st.get_node());
-                            }
-                            catch (StatementBuilder::no_token& e) {
-                                throw json::missing_definition();
-                            }
-                        }
+                    else if (c == QUOTE_CLOSE) {
+                        ended = true;
+                        break;
                     }
-                    
-                    NodeType top_type() const {
-                        if (!done()) {
-                            return top().get_node().get_type();
+                }
+            }
+            else {
+                while (cursor < length && !json_ends_bare(data[cursor])) cursor++;
+                ended = cursor < length;
+            }
+            partial.append(data + start, cursor - start);
+            if (!ended) check_partial();
+            return ended;
+        }
+
+        void ChunkTokenizer::check_partial() const {
+            if (max_string_length == 0 || partial_kind != TOKEN_STRING) return;
+            // no unescaped byte takes more than six raw ones (\u0041), and the
+            // last escape may be cut short, so this is the least it can unescape to
+            std::size_t least = partial.size() - 1;
+            if (partial_escaped) least = (least > 5)? (least - 5) / 6 : 0;
+            if (least > max_string_length) throw json::string_too_long();
+        }
+
+        bool ChunkTokenizer::next(Token& token, const char*& base) {
+            token = Token();
+
+            if (partial_kind != TOKEN_END) {
+                if (!complete_partial()) return false;
+                token.kind = partial_kind;
+                token.begin = (partial_kind == TOKEN_STRING)? 1 : 0;
+                token.end = (partial_kind == TOKEN_STRING)? partial.size() - 1 : partial.size();
+                token.escaped = partial_escaped;
+                base = partial.data();
+                partial_kind = TOKEN_END;
+                return true;
+            }
+
+            while (cursor < length && json_is_space(data[cursor])) cursor++;
+            if (cursor >= length) return false;
+
+            base = data;
+            token.begin = cursor;
+            switch (data[cursor])
+            {
+            case OBJECT_OPEN:
+                token.kind = TOKEN_OBJECT_OPEN;
+                break;
+            case OBJECT_CLOSE:
+                token.kind = TOKEN_OBJECT_CLOSE;
+                break;
+            case ARRAY_OPEN:
+                token.kind = TOKEN_ARRAY_OPEN;
+                break;
+            case ARRAY_CLOSE:
+                token.kind = TOKEN_ARRAY_CLOSE;
+                break;
+            case NAME_SPECIFIER:
+                token.kind = TOKEN_NAME_SPECIFIER;
+                break;
+            case END_PHRASE:
+                token.kind = TOKEN_END_PHRASE;
+                break;
+
+            case QUOTE_OPEN:
+                {
+                    const std::size_t start = cursor + 1;
+                    const char* quote = static_cast<const char*>(std::memchr(data + start, QUOTE_CLOSE, length - start));
+                    if (quote != nullptr) {
+                        std::size_t i = quote - data;
+                        if (std::memchr(data + start, ESCAPE, i - start) != nullptr) {
+                            token.escaped = true;
+                            i = start;
+                            while (i < length && data[i] != QUOTE_CLOSE) i += (data[i] == ESCAPE)? 2 : 1;
                         }
-                        else {
-                            return root.get_type();
+                        if (i < length) {
+                            token.kind = TOKEN_STRING;
+                            token.begin = start;
+                            token.end = i;
+                            cursor = i + 1;
+                            return true;
                         }
                     }
 
-                    StatementBuilder& top_mut() {
-                        return nest_stack.top();
+                    // cut off by the end of the piece, carry it to the next one
+                    partial.assign(data + cursor, length - cursor);
+                    partial_kind = TOKEN_STRING;
+                    partial_escape = partial_escaped = false;
+                    for (std::size_t i = 1; i < partial.size(); i++) {
+                        if (partial_escape) partial_escape = false;
+                        else if (partial[i] == ESCAPE) partial_escape = partial_escaped = true;
                     }
+                    check_partial();
+                    cursor = length;
+                    return false;
+                }
 
-                    const StatementBuilder& top() const {
-                        return nest_stack.top();
+            default:
+                {
+                    std::size_t i = cursor + 1;
+                    while (i < length && !json_ends_bare(data[i])) i++;
+                    if (i < length) {
+                        token.kind = TOKEN_BARE;
+                        token.end = cursor = i;
+                        return true;
                     }
 
-                    std::stack<StatementBuilder> nest_stack;
-                    StatementBuilder current;
+                    // a number can go on in the next piece
+                    partial.assign(data + cursor, length - cursor);
+                    partial_kind = TOKEN_BARE;
+                    partial_escaped = false;
+                    cursor = length;
+                    return false;
+                }
+            }
 
-                    // only valid after everything is popped
-                    bool _done = false;
-                    Node root;
-            };
+            token.end = ++cursor;
+            return true;
+        }
 
-            ParseHelper helper;
+        bool ChunkTokenizer::finish(Token& token, const char*& base) {
+            if (validate_utf8) utf8.finish();
+            if (partial_kind == TOKEN_STRING) throw json::unterminated_string();
+            if (partial_kind != TOKEN_BARE) return false;
+
+            token = Token();
+            token.kind = TOKEN_BARE;
+            token.end = partial.size();
+            base = partial.data();
+            partial_kind = TOKEN_END;
+            return true;
+        }
 
-            //pushes initial object
-            helper.parse_token(get_next_json_token(stream));
+        //= STRUCTURAL INDEX =================================
 
-            while (!stream.eof() && !helper.done())
-            {
-                helper.parse_token(get_next_json_token(stream));
-            }
-            
-            return Node(helper.get_root());
+        static constexpr std::size_t BLOCK_SIZE = 64;
+        static constexpr std::size_t INDEX_CHUNK_SIZE = 1 << 16;
 
+        inline unsigned trailing_zeroes(uint64_t bits) {
+            #if defined(__GNUC__) || defined(__clang__)
+            return __builtin_ctzll(bits);
+            #else
+            unsigned count = 0;
+            while (!(bits & 1)) { bits >>= 1; count++; }
+            return count;
+            #endif
         }
 
-        Node from_file_path(const std::string& path) {
-            std::ifstream stream(path);
-            return parse_from_istream(stream);
+        // bit i of the result is the xor of bits 0..i, turns quote positions
+        // into a mask of everything between an opening and closing quote
+        inline uint64_t prefix_xor(uint64_t bits) {
+            bits ^= bits << 1;
+            bits ^= bits << 2;
+            bits ^= bits << 4;
+            bits ^= bits << 8;
+            bits ^= bits << 16;
+            bits ^= bits << 32;
+            return bits;
         }
 
-        Node parse_from_string(const std::string& str) {
-            std::istringstream stream(str);
-            return parse_from_istream(stream);
+        void classify_block_scalar(const char* block, BlockMasks& masks) {
+            masks = BlockMasks();
+            for (std::size_t i = 0; i < BLOCK_SIZE; i++) {
+                const uint64_t bit = uint64_t(1) << i;
+                if (static_cast<unsigned char>(block[i]) >= 0x80) masks.non_ascii |= bit;
+                switch (block[i])
+                {
+                case QUOTE_OPEN:
+                    masks.quote |= bit;
+                    break;
+                case ESCAPE:
+                    masks.backslash |= bit;
+                    break;
+                case OBJECT_OPEN:
+                case OBJECT_CLOSE:
+                case ARRAY_OPEN:
+                case ARRAY_CLOSE:
+                case NAME_SPECIFIER:
+                case END_PHRASE:
+                    masks.structural |= bit;
+                    break;
+                case ' ':
+                case '\t':
+                case '\n':
+                case '\r':
+                    masks.whitespace |= bit;
+                    break;
+                default:
+                    break;
+                }
+            }
         }
 
-        Node parse_from_istream(const char* str) {
-            std::istringstream stream (str);
-            return parse_from_istream(stream);
+        #ifdef SJSON_X86_SIMD
+        __attribute__((target("sse2")))
+        inline uint64_t sse2_match(const __m128i* lanes, char c) {
+            const __m128i v = _mm_set1_epi8(c);
+            uint64_t bits = 0;
+            for (int i = 0; i < 4; i++) {
+                bits |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(lanes[i], v)))) << (i * 16);
+            }
+            return bits;
         }
 
-    }
+        __attribute__((target("sse2")))
+        void classify_block_sse2(const char* block, BlockMasks& masks) {
+            __m128i lanes[4];
+            for (int i = 0; i < 4; i++) {
+                lanes[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i * 16));
+            }
+            masks.quote = sse2_match(lanes, QUOTE_OPEN);
+            masks.backslash = sse2_match(lanes, ESCAPE);
+            masks.structural = sse2_match(lanes, OBJECT_OPEN) | sse2_match(lanes, OBJECT_CLOSE)
+                | sse2_match(lanes, ARRAY_OPEN) | sse2_match(lanes, ARRAY_CLOSE)
+                | sse2_match(lanes, NAME_SPECIFIER) | sse2_match(lanes, END_PHRASE);
+            masks.whitespace = sse2_match(lanes, ' ') | sse2_match(lanes, '\t')
+                | sse2_match(lanes, '\n') | sse2_match(lanes, '\r');
+            // the high bit of every byte is already a movemask away
+            masks.non_ascii = 0;
+            for (int i = 0; i < 4; i++) {
+                masks.non_ascii |= uint64_t(uint16_t(_mm_movemask_epi8(lanes[i]))) << (i * 16);
+            }
+        }
 
-    /*
-        =============================================
+        __attribute__((target("avx2")))
+        inline uint64_t avx2_match(const __m256i& lo, const __m256i& hi, char c) {
+            const __m256i v = _mm256_set1_epi8(c);
+            const uint32_t low_bits = uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, v)));
+            const uint32_t high_bits = uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, v)));
+            return uint64_t(low_bits) | (uint64_t(high_bits) << 32);
+        }
 
-                 MESSAGEPACK SECTION
-    
-        =============================================
-    */
-    namespace messagepack {
+        __attribute__((target("avx2")))
+        void classify_block_avx2(const char* block, BlockMasks& masks) {
+            const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+            const __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+            masks.quote = avx2_match(lo, hi, QUOTE_OPEN);
+            masks.backslash = avx2_match(lo, hi, ESCAPE);
+            masks.structural = avx2_match(lo, hi, OBJECT_OPEN) | avx2_match(lo, hi, OBJECT_CLOSE)
+                | avx2_match(lo, hi, ARRAY_OPEN) | avx2_match(lo, hi, ARRAY_CLOSE)
+                | avx2_match(lo, hi, NAME_SPECIFIER) | avx2_match(lo, hi, END_PHRASE);
+            masks.whitespace = avx2_match(lo, hi, ' ') | avx2_match(lo, hi, '\t')
+                | avx2_match(lo, hi, '\n') | avx2_match(lo, hi, '\r');
+            masks.non_ascii = uint64_t(uint32_t(_mm256_movemask_epi8(lo))) | (uint64_t(uint32_t(_mm256_movemask_epi8(hi))) << 32);
+        }
+        #endif
 
-    } // end of namespace messagepack
+        typedef void (*BlockClassifier)(const char*, BlockMasks&);
 
-}
+        BlockClassifier block_classifier(SimdLevel level) {
+            switch (level)
+            {
+            #ifdef SJSON_X86_SIMD
+            case SIMD_AVX2:
+                return classify_block_avx2;
+            case SIMD_SSE2:
+                return classify_block_sse2;
+            #endif
+            default:
+                return classify_block_scalar;
+            }
+        }
 
-#endif
+        //= STRING ESCAPES ===================================
+        inline bool json_needs_escape(unsigned char c) {
+            return c < 0x20 || c == QUOTE_CLOSE || c == ESCAPE;
+        }
 
-#ifdef SJSON_TEST
+        std::size_t find_escape_scalar(const char* text, std::size_t length) {
+            for (std::size_t i = 0; i < length; i++) {
+                if (json_needs_escape(text[i])) return i;
+            }
+            return length;
+        }
 
+        #ifdef SJSON_X86_SIMD
+        __attribute__((target("sse2")))
+        std::size_t find_escape_sse2(const char* text, std::size_t length) {
+            const __m128i quote = _mm_set1_epi8(QUOTE_CLOSE);
+            const __m128i backslash = _mm_set1_epi8(ESCAPE);
+            const __m128i control = _mm_set1_epi8(0x1f);
+            std::size_t i = 0;
+            for (; i + 16 <= length; i += 16) {
+                const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+                // unsigned v <= 0x1f is the same as max(v, 0x1f) == 0x1f
+                const __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+                    _mm_cmpeq_epi8(_mm_max_epu8(v, control), control));
+                const uint32_t bits = uint32_t(_mm_movemask_epi8(hits));
+                if (bits) return i + trailing_zeroes(bits);
+            }
+            return i + find_escape_scalar(text + i, length - i);
+        }
 
+        __attribute__((target("avx2")))
+        std::size_t find_escape_avx2(const char* text, std::size_t length) {
+            const __m256i quote = _mm256_set1_epi8(QUOTE_CLOSE);
+            const __m256i backslash = _mm256_set1_epi8(ESCAPE);
+            const __m256i control = _mm256_set1_epi8(0x1f);
+            std::size_t i = 0;
+            for (; i + 32 <= length; i += 32) {
+                const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i));
+                const __m256i hits = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, backslash)),
+                    _mm256_cmpeq_epi8(_mm256_max_epu8(v, control), control));
+                const uint32_t bits = uint32_t(_mm256_movemask_epi8(hits));
+                if (bits) return i + trailing_zeroes(bits);
+            }
+            return i + find_escape_sse2(text + i, length - i);
+        }
+        #endif
 
-#include <gtest/gtest.h>
-using sjson::Node;
+        std::size_t find_escape(const char* text, std::size_t length, SimdLevel level) {
+            switch (level)
+            {
+            #ifdef SJSON_X86_SIMD
+            case SIMD_AVX2:
+                return find_escape_avx2(text, length);
+            case SIMD_SSE2:
+                return find_escape_sse2(text, length);
+            #endif
+            default:
+                return find_escape_scalar(text, length);
+            }
+        }
 
-TEST(multitype, create_and_equivocate) {
-    Node a((long int)10);
-    ASSERT_EQ(a.as_int(), 10);
-    ASSERT_EQ(a.as_real(), 10.0);
+        SimdLevel detect_simd_level() {
+            #ifdef SJSON_X86_SIMD
+            static const SimdLevel level = __builtin_cpu_supports("avx2")? SIMD_AVX2 : SIMD_SSE2;
+            return level;
+            #else
+            return SIMD_NONE;
+            #endif
+        }
 
-    Node b(7.4);
-    ASSERT_EQ(b.as_real(), 7.4);
+        uint64_t StructuralScanner::scan(const BlockMasks& masks) {
+            static constexpr uint64_t EVEN_BITS = 0x5555555555555555ULL;
+            static constexpr uint64_t ODD_BITS = ~EVEN_BITS;
+
+            // Characters escaped by an odd length run of backslashes. Runs are
+            // found by adding their start bit to them and looking at where the
+            // carry lands, separately for runs starting on even and odd bytes.
+            const uint64_t backslash = masks.backslash;
+            const uint64_t starts = backslash & ~(backslash << 1);
+            const uint64_t even_start_mask = EVEN_BITS ^ prev_escaped;
+            const uint64_t even_starts = starts & even_start_mask;
+            const uint64_t odd_starts = starts & ~even_start_mask;
+
+            const uint64_t even_carries = backslash + even_starts;
+            uint64_t odd_carries = backslash + odd_starts;
+            const bool run_continues = odd_carries < backslash;
+            odd_carries |= prev_escaped;
+            prev_escaped = run_continues? 1 : 0;
+
+            const uint64_t even_carry_ends = even_carries & ~backslash;
+            const uint64_t odd_carry_ends = odd_carries & ~backslash;
+            const uint64_t escaped = (even_carry_ends & ODD_BITS) | (odd_carry_ends & EVEN_BITS);
+
+            // Opening quotes and string contents are set, closing quotes are not.
+            const uint64_t quotes = masks.quote & ~escaped;
+            const uint64_t in_string = prefix_xor(quotes) ^ prev_in_string;
+            prev_in_string = uint64_t(int64_t(in_string) >> 63);
+
+            // first byte of every run of unquoted, non structural characters
+            const uint64_t bare = ~(masks.structural | masks.whitespace | quotes | in_string);
+            const uint64_t bare_starts = bare & ~((bare << 1) | prev_bare);
+            prev_bare = bare >> 63;
+
+            return (masks.structural & ~in_string) | quotes | bare_starts;
+        }
 
-    Node c("this is a string");
-    ASSERT_EQ(c.as_string(), "this is a string");
+        void Utf8Validator::feed(const char* bytes, std::size_t length, std::size_t base) {
+            for (std::size_t i = 0; i < length; i++) {
+                const unsigned char c = bytes[i];
+                if (needed > 0) {
+                    if (c < low || c > high) throw json::invalid_utf8(sequence_start);
+                    low = 0x80;
+                    high = 0xbf;
+                    needed--;
+                    continue;
+                }
+                if (c < 0x80) continue;
 
-    Node d(Node::array({
-        Node(10l),
-        Node("String"),
-    }));
+                // the first continuation byte is narrowed to rule out overlong
+                // forms, surrogates and anything past U+10FFFF
+                sequence_start = base + i;
+                if (c >= 0xc2 && c <= 0xdf) {
+                    needed = 1;
+                }
+                else if (c >= 0xe0 && c <= 0xef) {
+                    needed = 2;
+                    if (c == 0xe0) low = 0xa0;
+                    if (c == 0xed) high = 0x9f;
+                }
+                else if (c >= 0xf0 && c <= 0xf4) {
+                    needed = 3;
+                    if (c == 0xf0) low = 0x90;
+                    if (c == 0xf4) high = 0x8f;
+                }
+                else {
+                    throw json::invalid_utf8(sequence_start);
+                }
+            }
+        }
 
-    Node::array res = d.as_array();
-    ASSERT_EQ(res[0].as_int(), 10);
-    ASSERT_EQ(res[1].as_string(), "String");
-}
+        void Utf8Validator::finish() const {
+            if (needed > 0) throw json::invalid_utf8(sequence_start);
+        }
 
-TEST(multitype, to_json) {
-    const Node::array node_array = {Node("my string"), Node((Node::integer)2)};
-    const Node array_node(node_array);
-    const Node::string test_str = "this is a string";
-    const Node::integer test_number = 64;
-    const Node::real test_real = 33.2;
+        IndexedTokenizer::IndexedTokenizer(const char* d, std::size_t l, SimdLevel simd, bool validate)
+            : data(d), length(l), level(simd), validate_utf8(validate) {
+            structurals.reserve(INDEX_CHUNK_SIZE / 4);
+        }
 
-    const Node obj_node = Node((Node::object)
-        {
-            {"my_array", Node(node_array)}, 
-            {"my_string", Node(test_str)},
-            {"my_real" , Node(test_real)},
-            {"my_int", Node(test_number)}
-        });
+        std::size_t IndexedTokenizer::position() const {
+            return cursor;
+        }
 
-    std::string as_json = sjson::json::node_to_json_string(obj_node);
+        void IndexedTokenizer::index_chunk() {
+        #ifdef SJSON_STATS
+            const auto started = std::chrono::steady_clock::now();
+        #endif
+            const BlockClassifier classify = block_classifier(level);
+
+            chunk_base = indexed_up_to;
+            const std::size_t chunk_end = std::min(length, chunk_base + INDEX_CHUNK_SIZE);
+            structurals.clear();
+            structural_cursor = 0;
+
+            BlockMasks masks;
+            for (std::size_t block = chunk_base; block < chunk_end; block += BLOCK_SIZE) {
+                uint64_t valid = ~uint64_t(0);
+                if (block + BLOCK_SIZE <= length) {
+                    classify(data + block, masks);
+                }
+                else {
+                    // pad the tail with whitespace so it reads like the end of a document
+                    char tail[BLOCK_SIZE];
+                    std::memset(tail, ' ', BLOCK_SIZE);
+                    std::memcpy(tail, data + block, length - block);
+                    classify(tail, masks);
+                    valid = (uint64_t(1) << (length - block)) - 1;
+                }
 
-    DEBUG_PRINT('\n' << as_json);
+                // the non ascii mask comes out of the same pass, so ascii blocks cost nothing more
+                if (validate_utf8 && ((masks.non_ascii & valid) || utf8.pending())) {
+                    utf8.feed(data + block, std::min(BLOCK_SIZE, length - block), block);
+                }
+
+                uint64_t bits = scanner.scan(masks) & valid;
+                const uint32_t offset = uint32_t(block - chunk_base);
+                while (bits) {
+                    structurals.push_back(offset + trailing_zeroes(bits));
+                    bits &= bits - 1;
+                }
+            }
+            indexed_up_to = chunk_end;
+            if (validate_utf8 && indexed_up_to == length) utf8.finish();
+        #ifdef SJSON_STATS
+            if (stats != nullptr) {
+                stats->tokenize_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count();
+            }
+        #endif
+        }
+
+        bool IndexedTokenizer::next_structural(std::size_t& offset) {
+            while (structural_cursor >= structurals.size()) {
+                if (indexed_up_to >= length) return false;
+                index_chunk();
+            }
+            offset = chunk_base + structurals[structural_cursor++];
+            return true;
+        }
+
+        bool IndexedTokenizer::next(Token& token) {
+            token = Token();
+
+            std::size_t at;
+            if (!next_structural(at)) {
+                cursor = length;
+                token.begin = token.end = length;
+                return false;
+            }
+
+            token.begin = at;
+            switch (data[at])
+            {
+            case OBJECT_OPEN:
+                token.kind = TOKEN_OBJECT_OPEN;
+                break;
+            case OBJECT_CLOSE:
+                token.kind = TOKEN_OBJECT_CLOSE;
+                break;
+            case ARRAY_OPEN:
+                token.kind = TOKEN_ARRAY_OPEN;
+                break;
+            case ARRAY_CLOSE:
+                token.kind = TOKEN_ARRAY_CLOSE;
+                break;
+            case NAME_SPECIFIER:
+                token.kind = TOKEN_NAME_SPECIFIER;
+                break;
+            case END_PHRASE:
+                token.kind = TOKEN_END_PHRASE;
+                break;
+
+            case QUOTE_OPEN:
+                {
+                    // the next index entry is always the closing quote
+                    std::size_t close;
+                    if (!next_structural(close)) throw json::unterminated_string();
+
+                    token.kind = TOKEN_STRING;
+                    token.begin = at + 1;
+                    token.end = close;
+                    token.escaped = std::memchr(data + token.begin, ESCAPE, close - token.begin) != nullptr;
+                    cursor = close + 1;
+                    return true;
+                }
+
+            default:
+                {
+                    token.kind = TOKEN_BARE;
+                    std::size_t i = at + 1;
+                    while (i < length && !json_is_space(data[i]) && !json_is_delimeter(data[i]) && data[i] != QUOTE_OPEN) i++;
+                    token.end = i;
+                    cursor = i;
+                    return true;
+                }
+            }
+
+            token.end = cursor = at + 1;
+            return true;
+        }
+
+        bool is_simple_escape(char code) {
+            switch (code)
+            {
+            case 'b': case 'f': case 'n': case 'r': case 't': case '"': case '\\': case '/':
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        // the four hex digits of a \u escape
+        uint32_t read_hex4(const char* p, const char* end) {
+            if (end - p < 4) throw json::invalid_escape();
+            uint32_t value = 0;
+            for (int i = 0; i < 4; i++) {
+                const char c = p[i];
+                uint32_t digit;
+                if (c >= '0' && c <= '9') digit = c - '0';
+                else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+                else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+                else throw json::invalid_escape();
+                value = value * 16 + digit;
+            }
+            return value;
+        }
+
+        char* write_utf8(uint32_t code_point, char* out) {
+            if (code_point < 0x80) {
+                *(out++) = char(code_point);
+            }
+            else if (code_point < 0x800) {
+                *(out++) = char(0xc0 | (code_point >> 6));
+                *(out++) = char(0x80 | (code_point & 0x3f));
+            }
+            else if (code_point < 0x10000) {
+                *(out++) = char(0xe0 | (code_point >> 12));
+                *(out++) = char(0x80 | ((code_point >> 6) & 0x3f));
+                *(out++) = char(0x80 | (code_point & 0x3f));
+            }
+            else {
+                *(out++) = char(0xf0 | (code_point >> 18));
+                *(out++) = char(0x80 | ((code_point >> 12) & 0x3f));
+                *(out++) = char(0x80 | ((code_point >> 6) & 0x3f));
+                *(out++) = char(0x80 | (code_point & 0x3f));
+            }
+            return out;
+        }
+
+        // Decodes the code point of a \u escape, begin is just past the u.
+        // A surrogate pair takes both escapes, and a surrogate without its
+        // other half becomes U+FFFD. Returns where the escape ends.
+        const char* decode_unicode_escape(const char* begin, const char* end, char*& written) {
+            static constexpr uint32_t REPLACEMENT = 0xfffd;
+            uint32_t code_point = read_hex4(begin, end);
+            begin += 4;
+
+            if (code_point >= 0xd800 && code_point <= 0xdbff) {
+                if (end - begin >= 6 && begin[0] == ESCAPE && begin[1] == 'u') {
+                    const uint32_t low = read_hex4(begin + 2, end);
+                    if (low >= 0xdc00 && low <= 0xdfff) {
+                        code_point = 0x10000 + ((code_point - 0xd800) << 10) + (low - 0xdc00);
+                        begin += 6;
+                    }
+                    else {
+                        code_point = REPLACEMENT;
+                    }
+                }
+                else {
+                    code_point = REPLACEMENT;
+                }
+            }
+            else if (code_point >= 0xdc00 && code_point <= 0xdfff) {
+                code_point = REPLACEMENT;
+            }
+
+            written = write_utf8(code_point, written);
+            return begin;
+        }
+
+        // Writes the raw form of an escaped string body to out and returns
+        // its length. The raw form is never longer than the escaped one.
+        std::size_t unescape_json_string(const char* begin, const char* end, char* out) {
+            char* written = out;
+            while (begin < end) {
+                const char* escape = static_cast<const char*>(std::memchr(begin, ESCAPE, end - begin));
+                if (escape == nullptr) escape = end;
+                std::memcpy(written, begin, escape - begin);
+                written += escape - begin;
+                if (escape + 1 >= end) break;
+
+                const char code = escape[1];
+                begin = escape + 2;
+                if (code == 'u') {
+                    begin = decode_unicode_escape(begin, end, written);
+                    continue;
+                }
+                if (!is_simple_escape(code)) throw json::invalid_escape();
+                *(written++) = escape_to_raw(code);
+            }
+            return written - out;
+        }
+
+        // Appends the raw form of an escaped string body to out.
+        void unescape_json_string(const char* begin, const char* end, std::string& out) {
+            const std::size_t start = out.size();
+            out.resize(start + (end - begin));
+            out.resize(start + unescape_json_string(begin, end, &out[start]));
+        }
+
+        Node token_to_node(const Token& token, const char* data) {
+            const char* begin = data + token.begin;
+            const std::size_t length = token.end - token.begin;
+
+            if (token.kind == TOKEN_STRING) {
+                if (!token.escaped) {
+                    return Node(Node::string(begin, length));
+                }
+                Node::string raw;
+                unescape_json_string(begin, begin + length, raw);
+                return Node(std::move(raw));
+            }
+
+            return bare_to_node(begin, begin + length);
+        }
+
+        std::string_view token_text(const Token& token, const char* data, std::string& scratch) {
+            const char* begin = data + token.begin;
+            const std::size_t length = token.end - token.begin;
+            if (!token.escaped) return std::string_view(begin, length);
+
+            scratch.clear();
+            unescape_json_string(begin, begin + length, scratch);
+            return scratch;
+        }
+
+        //= STATS ============================================
+        std::atomic<ParseTracer*> parse_tracer(nullptr);
+        std::atomic<std::size_t> tracer_sample_every(1);
+        std::atomic<std::size_t> tracer_parses(0);
+
+        void set_parse_tracer(ParseTracer* tracer, std::size_t sample_every) {
+            tracer_sample_every.store(std::max<std::size_t>(sample_every, 1));
+            tracer_parses.store(0);
+            parse_tracer.store(tracer);
+        }
+
+        void ParseStats::merge(const ParseStats& other) {
+            bytes += other.bytes;
+            tokens += other.tokens;
+            for (std::size_t type = 0; type <= OBJECT; type++) nodes[type] += other.nodes[type];
+            max_depth = std::max(max_depth, other.max_depth);
+            allocations += other.allocations;
+            allocated_bytes += other.allocated_bytes;
+            total_ns += other.total_ns;
+            tokenize_ns += other.tokenize_ns;
+            build_ns += other.build_ns;
+            number_ns += other.number_ns;
+        }
+
+    #ifdef SJSON_STATS
+        // the tracer if this parse is one of the samples
+        ParseTracer* sampled_tracer() {
+            ParseTracer* tracer = parse_tracer.load(std::memory_order_relaxed);
+            if (tracer == nullptr) return nullptr;
+            if (tracer_parses.fetch_add(1, std::memory_order_relaxed) % tracer_sample_every.load(std::memory_order_relaxed) != 0) return nullptr;
+            return tracer;
+        }
+
+        // stats of the parse running on this thread, for the memory resources to count into
+        thread_local ParseStats* allocation_stats = nullptr;
+
+        void note_allocation(std::size_t bytes) {
+            if (allocation_stats == nullptr) return;
+            allocation_stats->allocations++;
+            allocation_stats->allocated_bytes += bytes;
+        }
+
+        // The heap, counting into allocation_stats while a parse collects.
+        class StatsResource : public std::pmr::memory_resource {
+            private:
+                void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+                    note_allocation(bytes);
+                    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+                }
+                void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override {
+                    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+                }
+                bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+                    return this == &other;
+                }
+        };
+
+        // never destroyed, trees built with it can outlive everything else
+        std::pmr::memory_resource* stats_resource() {
+            static StatsResource* resource = new StatsResource();
+            return resource;
+        }
+    #endif
+
+        //= DOM BUILDER ======================================
+        DomBuilder::DomBuilder(std::pmr::memory_resource* resource, bool arena_strings, KeyTable* keys, std::string_view borrowable)
+            : resource(resource), arena_strings(arena_strings), keys(keys), borrowable(borrowable) {}
+
+        Node& DomBuilder::next_slot() {
+            if (nest_stack.empty()) return root;
+
+            Node& top = *nest_stack.back();
+            if (top.get_type() == ARRAY) {
+                return top.as_array_mut().emplace_back();
+            }
+            return *member;
+        }
+
+        void DomBuilder::collect(ParseStats* s) {
+            stats = s;
+        #ifdef SJSON_STATS
+            // Swapped for the counting resource rather than wrapped, since
+            // the tree keeps using it long after the builder is gone.
+            if (stats != nullptr && resource == std::pmr::new_delete_resource()) {
+                resource = stats_resource();
+            }
+        #endif
+        }
+
+        void DomBuilder::count_node(NodeType type) {
+        #ifdef SJSON_STATS
+            if (stats == nullptr) return;
+            stats->nodes[type]++;
+            stats->max_depth = std::max(stats->max_depth, nest_stack.size());
+        #else
+            (void)type;
+        #endif
+        }
+
+        void DomBuilder::start_object() {
+            Node& slot = next_slot();
+            slot = Node(Node::object(resource));
+            nest_stack.push_back(&slot);
+            count_node(OBJECT);
+        }
+
+        void DomBuilder::end_object() {
+            nest_stack.pop_back();
+        }
+
+        void DomBuilder::start_array() {
+            Node& slot = next_slot();
+            slot = Node(Node::array(resource));
+            nest_stack.push_back(&slot);
+            count_node(ARRAY);
+        }
+
+        void DomBuilder::end_array() {
+            nest_stack.pop_back();
+        }
+
+        void DomBuilder::key(std::string_view text) {
+            // the member is added now and its value filled in when it arrives
+            Node::object& map = nest_stack.back()->as_object_mut();
+            const Key key = (keys)? keys->intern(text) : Key(text);
+            const auto added = map.emplace(key, Node());
+            if (!added.second) throw json::duplicate_label();
+            member = &added.first->second;
+        }
+
+        void DomBuilder::string(std::string_view text) {
+            count_node(STRING);
+            const uintptr_t start = reinterpret_cast<uintptr_t>(borrowable.data());
+            const uintptr_t at = reinterpret_cast<uintptr_t>(text.data());
+            if (!borrowable.empty() && at >= start && at + text.size() <= start + borrowable.size()) {
+                next_slot() = Node::borrow_string(text);
+                return;
+            }
+            if (!arena_strings) {
+            #ifdef SJSON_STATS
+                static const std::size_t inline_capacity = std::string().capacity();
+                if (stats != nullptr && text.size() > inline_capacity) {
+                    stats->allocations++;
+                    stats->allocated_bytes += text.size() + 1;
+                }
+            #endif
+                next_slot() = Node(Node::string(text));
+                return;
+            }
+            if (text.empty()) {
+                next_slot() = Node::borrow_string(std::string_view());
+                return;
+            }
+            char* copy = static_cast<char*>(resource->allocate(text.size(), 1));
+            std::memcpy(copy, text.data(), text.size());
+            next_slot() = Node::borrow_string(std::string_view(copy, text.size()));
+        }
+
+        void DomBuilder::integer(Node::integer value) {
+            count_node(INTEGER);
+            next_slot() = Node(value);
+        }
+
+        void DomBuilder::real(Node::real value) {
+            count_node(REAL);
+            next_slot() = Node(value);
+        }
+
+        void DomBuilder::boolean(bool value) {
+            count_node(INTEGER);
+            next_slot() = Node(static_cast<Node::integer>(value));
+        }
+
+        void DomBuilder::null() {
+            count_node(NONE);
+            next_slot() = Node();
+        }
+
+        Node DomBuilder::take_root() {
+            return std::move(root);
+        }
+
+        // Builds a Node tree from a stream of tokens, one token at a time,
+        // by running them through a SaxParser into a DomBuilder.
+        class ParseHelper {
+            public:
+                ParseHelper(std::pmr::memory_resource* resource = std::pmr::get_default_resource(), bool arena_strings = false, KeyTable* keys = nullptr,
+                    std::string_view borrowable = std::string_view())
+                    : builder(resource, arena_strings, keys, borrowable), parser(builder) {}
+
+                void parse_token(const Token& token, const char* data) {
+                    parser.parse_token(token, data);
+                }
+
+                void collect(ParseStats* stats) {
+                    builder.collect(stats);
+                    parser.collect(stats);
+                }
+
+                void limit(const ParseOptions& options) {
+                    parser.limit(options);
+                }
+
+                void finish() {
+                    parser.finish();
+                }
+
+                bool done() const {
+                    return parser.done();
+                }
+
+                // moves the finished tree out of the helper
+                Node take_root() {
+                    if (!done()) {
+                        DEBUG_PRINT( __LINE__ << ": STACK NOT EMPTY!!!" );
+                        assert(false);
+                    }
+                    return builder.take_root();
+                }
+
+            private:
+                DomBuilder builder;
+                SaxParser<DomBuilder> parser;
+        };
+
+        static constexpr std::size_t STREAM_BLOCK_SIZE = 1 << 16;
+
+        // Reads the rest of a stream into one contiguous buffer, a block at
+        // a time. Throws too_many_bytes as soon as more than max_bytes came in.
+        std::string read_stream_to_buffer(std::istream& stream, std::size_t max_bytes = 0) {
+            std::string buffer;
+            std::size_t filled = 0;
+            while (stream) {
+                buffer.resize(filled + STREAM_BLOCK_SIZE);
+                stream.read(&buffer[filled], STREAM_BLOCK_SIZE);
+                filled += stream.gcount();
+                if (max_bytes > 0 && filled > max_bytes) throw too_many_bytes();
+            }
+            buffer.resize(filled);
+            return buffer;
+        }
+
+    #ifdef SJSON_STATS
+        // run_parser with every counter collected into stats. open and close,
+        // if given, are parsed around the tokens, as parse_segment needs.
+        void run_parser_collecting(ParseHelper& helper, IndexedTokenizer& tokenizer, const char* data, std::size_t length, ParseStats* stats, ParseTracer* tracer,
+            const Token* open = nullptr, const Token* close = nullptr) {
+            *stats = ParseStats();
+            stats->bytes = length;
+            if (tracer) tracer->parse_started(length);
+
+            tokenizer.collect(stats);
+            helper.collect(stats);
+            allocation_stats = stats;
+            const auto start = std::chrono::steady_clock::now();
+            const auto done = [&]() {
+                allocation_stats = nullptr;
+                stats->total_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+                stats->build_ns = stats->total_ns - std::min(stats->total_ns, stats->tokenize_ns);
+                if (tracer) tracer->parse_finished(*stats);
+            };
+
+            try {
+                if (open) helper.parse_token(*open, data);
+                Token token;
+                while (!helper.done() && tokenizer.next(token)) {
+                    stats->tokens++;
+                    helper.parse_token(token, data);
+                }
+                if (close) helper.parse_token(*close, data);
+                helper.finish();
+            }
+            catch (...) {
+                done();
+                throw;
+            }
+            done();
+        }
+    #endif
+
+        void run_parser(ParseHelper& helper, const char* data, std::size_t length, const ParseOptions& options = ParseOptions()) {
+            if (options.max_bytes > 0 && length > options.max_bytes) throw too_many_bytes();
+            helper.limit(options);
+            IndexedTokenizer tokenizer(data, length, detect_simd_level(), options.validate_utf8);
+        #ifdef SJSON_STATS
+            ParseTracer* tracer = sampled_tracer();
+            if (options.stats != nullptr || tracer != nullptr) {
+                ParseStats sampled;
+                run_parser_collecting(helper, tokenizer, data, length, (options.stats)? options.stats : &sampled, tracer);
+                return;
+            }
+        #endif
+            Token token;
+
+            while (!helper.done() && tokenizer.next(token))
+            {
+                helper.parse_token(token, data);
+            }
+            helper.finish();
+        }
+
+        Node parse_from_buffer(const char* data, std::size_t length, const ParseOptions& options) {
+            ParseHelper helper;
+            run_parser(helper, data, length, options);
+            return helper.take_root();
+        }
+
+        Node parse_from_istream(std::istream& stream, const ParseOptions& options) {
+            const std::string buffer = read_stream_to_buffer(stream, options.max_bytes);
+            return parse_from_buffer(buffer.data(), buffer.size(), options);
+        }
+
+    #ifdef SJSON_MMAP
+        MappedFile::MappedFile(const std::string& path) {
+            const int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) throw std::system_error(errno, std::generic_category(), path);
+
+            struct stat info;
+            if (::fstat(fd, &info) != 0) {
+                const int error = errno;
+                ::close(fd);
+                throw std::system_error(error, std::generic_category(), path);
+            }
+
+            length = static_cast<std::size_t>(info.st_size);
+            // mmap refuses empty files, an empty file is just no bytes
+            if (length > 0) {
+                void* mapped = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapped == MAP_FAILED) {
+                    const int error = errno;
+                    ::close(fd);
+                    throw std::system_error(error, std::generic_category(), path);
+                }
+                // the parser reads front to back, so let the kernel read ahead
+                ::madvise(mapped, length, MADV_SEQUENTIAL);
+                bytes = static_cast<const char*>(mapped);
+            }
+            // the mapping stays valid without the descriptor
+            ::close(fd);
+        }
+
+        MappedFile::~MappedFile() {
+            if (bytes != nullptr) ::munmap(const_cast<char*>(bytes), length);
+        }
+    #else
+        MappedFile::MappedFile(const std::string& path) {
+            std::ifstream stream(path, std::ios::binary);
+            if (!stream) throw std::system_error(std::make_error_code(std::errc::no_such_file_or_directory), path);
+            contents = read_stream_to_buffer(stream);
+            bytes = contents.data();
+            length = contents.size();
+        }
+
+        MappedFile::~MappedFile() {}
+    #endif
+
+        Node from_file_path(const std::string& path, const ParseOptions& options) {
+            const MappedFile file(path);
+            return parse_from_buffer(file.data(), file.size(), options);
+        }
+
+        Node parse_from_string(const std::string& str, const ParseOptions& options) {
+            return parse_from_buffer(str.data(), str.size(), options);
+        }
+
+        Node parse_from_string(std::string_view str, const ParseOptions& options) {
+            return parse_from_buffer(str.data(), str.size(), options);
+        }
+
+        Node parse_from_string(const char* str, const ParseOptions& options) {
+            return parse_from_string(std::string_view(str), options);
+        }
+
+        //= LINES ============================================
+        // One batch of lines, parsed by a worker and delivered in order.
+        struct LineBatch {
+            struct Outcome {
+                // line within the batch, counting from zero
+                std::size_t line;
+                Node record;
+                std::exception_ptr error;
+            };
+
+            std::size_t begin;
+            std::size_t end;
+            std::size_t lines = 0;
+            std::vector<Outcome> outcomes;
+            // anything that went wrong outside a line's parse, such as
+            // running out of memory, rethrown from parse_lines
+            std::exception_ptr failure;
+            // every line's stats added up, when they are collected
+            ParseStats stats;
+            bool ready = false;
+        };
+
+        void parse_line_batch(const char* data, LineBatch& batch, ParseOptions options) {
+            // the caller's stats are only touched by the delivering thread
+            const bool collect = options.stats != nullptr;
+            ParseStats line_stats;
+            if (collect) options.stats = &line_stats;
+
+            std::size_t at = batch.begin;
+            while (at < batch.end) {
+                const char* newline = static_cast<const char*>(std::memchr(data + at, '\n', batch.end - at));
+                const std::size_t line_end = (newline)? newline - data : batch.end;
+
+                std::size_t first = at;
+                while (first < line_end && json_is_space(data[first])) first++;
+                if (first < line_end) {
+                    LineBatch::Outcome outcome{batch.lines, Node(), nullptr};
+                    try {
+                        outcome.record = parse_from_buffer(data + first, line_end - first, options);
+                    }
+                    catch (...) {
+                        outcome.error = std::current_exception();
+                    }
+                    if (collect) batch.stats.merge(line_stats);
+                    batch.outcomes.push_back(std::move(outcome));
+                }
+
+                batch.lines++;
+                at = line_end + 1;
+            }
+        }
+
+        void parse_lines(const char* data, std::size_t length, const LineCallback& on_record, const LineErrorCallback& on_error, const LinesOptions& options) {
+            // batches end just after a newline, so no line is split
+            std::vector<LineBatch> batches;
+            for (std::size_t begin = 0; begin < length;) {
+                std::size_t end = std::min(length, begin + std::max<std::size_t>(options.batch_bytes, 1));
+                if (end < length) {
+                    const char* newline = static_cast<const char*>(std::memchr(data + end, '\n', length - end));
+                    end = (newline)? newline - data + 1 : length;
+                }
+                LineBatch batch;
+                batch.begin = begin;
+                batch.end = end;
+                batches.push_back(std::move(batch));
+                begin = end;
+            }
+
+            unsigned int threads = (options.threads > 0)? options.threads : std::max(1u, std::thread::hardware_concurrency());
+            threads = std::min<std::size_t>(threads, std::max<std::size_t>(batches.size(), 1));
+            const std::size_t in_flight = (options.batches_in_flight > 0)? options.batches_in_flight : 2 * threads;
+
+            std::mutex mutex;
+            std::condition_variable ready_changed;
+            std::condition_variable room_changed;
+            std::size_t next_batch = 0;
+            std::size_t delivered = 0;
+            bool stopping = false;
+
+            auto work = [&]() {
+                while (true) {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    room_changed.wait(lock, [&]() {
+                        return stopping || next_batch >= batches.size() || next_batch < delivered + in_flight;
+                    });
+                    if (stopping || next_batch >= batches.size()) return;
+                    LineBatch& batch = batches[next_batch++];
+                    lock.unlock();
+
+                    // nothing may escape the thread, that would terminate
+                    try {
+                        parse_line_batch(data, batch, options.parse);
+                    }
+                    catch (...) {
+                        batch.failure = std::current_exception();
+                    }
+
+                    lock.lock();
+                    batch.ready = true;
+                    ready_changed.notify_all();
+                }
+            };
+
+            std::vector<std::thread> workers;
+            auto stop = [&]() {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    stopping = true;
+                }
+                room_changed.notify_all();
+                for (std::thread& worker : workers) worker.join();
+            };
+
+            if (options.parse.stats) *options.parse.stats = ParseStats();
+            try {
+                for (unsigned int i = 0; i < threads; i++) {
+                    workers.emplace_back(work);
+                }
+
+                std::size_t first_line = 1;
+                for (std::size_t i = 0; i < batches.size(); i++) {
+                    LineBatch& batch = batches[i];
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        ready_changed.wait(lock, [&]() { return batch.ready; });
+                    }
+
+                    for (LineBatch::Outcome& outcome : batch.outcomes) {
+                        if (outcome.error) on_error(first_line + outcome.line, outcome.error);
+                        else on_record(first_line + outcome.line, std::move(outcome.record));
+                    }
+                    if (batch.failure) std::rethrow_exception(batch.failure);
+                    if (options.parse.stats) options.parse.stats->merge(batch.stats);
+                    first_line += batch.lines;
+                    std::vector<LineBatch::Outcome>().swap(batch.outcomes);
+
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        delivered = i + 1;
+                    }
+                    room_changed.notify_all();
+                }
+            }
+            catch (...) {
+                stop();
+                throw;
+            }
+            stop();
+        }
+
+        void parse_lines(std::string_view text, const LineCallback& on_record, const LineErrorCallback& on_error, const LinesOptions& options) {
+            parse_lines(text.data(), text.size(), on_record, on_error, options);
+        }
+
+        //= PARALLEL =========================================
+        // A run of top level elements or members, without the commas around it.
+        struct TopLevelSegment {
+            std::size_t begin;
+            std::size_t end;
+        };
+
+        // Finds comma offsets at depth one, at least target bytes apart, and
+        // returns the runs between them. False if the top level isn't a
+        // container or doesn't close, the sequential parser deals with those.
+        // With validate_utf8 this pass checks the whole text, the bytes
+        // between segments included, and throws invalid_utf8.
+        bool split_top_level(const char* data, std::size_t length, std::size_t target, bool validate_utf8, NodeType& type, std::vector<TopLevelSegment>& segments) {
+            IndexedTokenizer tokenizer(data, length, detect_simd_level(), validate_utf8);
+            Token token;
+            if (!tokenizer.next(token)) return false;
+            if (token.kind == TOKEN_ARRAY_OPEN) type = ARRAY;
+            else if (token.kind == TOKEN_OBJECT_OPEN) type = OBJECT;
+            else return false;
+
+            std::size_t begin = token.end;
+            std::size_t depth = 1;
+            while (tokenizer.next(token)) {
+                switch (token.kind)
+                {
+                case TOKEN_OBJECT_OPEN:
+                case TOKEN_ARRAY_OPEN:
+                    depth++;
+                    break;
+                case TOKEN_OBJECT_CLOSE:
+                case TOKEN_ARRAY_CLOSE:
+                    if (--depth == 0) {
+                        segments.push_back({begin, token.begin});
+                        return true;
+                    }
+                    break;
+                case TOKEN_END_PHRASE:
+                    if (depth == 1 && token.begin - begin >= target) {
+                        segments.push_back({begin, token.begin});
+                        begin = token.end;
+                    }
+                    break;
+                default:
+                    break;
+                }
+            }
+            return false;
+        }
+
+        // Parses a segment as the body of a container of the given type.
+        Node parse_segment(const char* data, const TopLevelSegment& segment, NodeType type, const ParseOptions& options) {
+            ParseHelper helper;
+            helper.limit(options);
+            const char* base = data + segment.begin;
+            const std::size_t length = segment.end - segment.begin;
+            // split_top_level has already validated the utf-8
+            IndexedTokenizer tokenizer(base, length, detect_simd_level(), false);
+
+            Token open;
+            open.kind = (type == ARRAY)? TOKEN_ARRAY_OPEN : TOKEN_OBJECT_OPEN;
+            Token close;
+            close.kind = (type == ARRAY)? TOKEN_ARRAY_CLOSE : TOKEN_OBJECT_CLOSE;
+        #ifdef SJSON_STATS
+            if (options.stats != nullptr) {
+                run_parser_collecting(helper, tokenizer, base, length, options.stats, nullptr, &open, &close);
+                return helper.take_root();
+            }
+        #endif
+
+            helper.parse_token(open, base);
+            Token token;
+            while (tokenizer.next(token)) {
+                helper.parse_token(token, base);
+            }
+            helper.parse_token(close, base);
+            helper.finish();
+            return helper.take_root();
+        }
+
+        Node parse_parallel(const char* data, std::size_t length, const ParallelOptions& options) {
+            const unsigned int threads = (options.threads > 0)? options.threads : std::max(1u, std::thread::hardware_concurrency());
+            const std::size_t min_segment = std::max<std::size_t>(options.min_segment_bytes, 1);
+            // a node count covers the whole document, which segments can't check
+            if (threads < 2 || length / min_segment < 2 || options.parse.max_nodes > 0) {
+                return parse_from_buffer(data, length, options.parse);
+            }
+            if (options.parse.max_bytes > 0 && length > options.parse.max_bytes) throw too_many_bytes();
+
+            // a few segments per thread, so one slow segment doesn't hold up the rest
+            NodeType type = NONE;
+            std::vector<TopLevelSegment> segments;
+            bool split = false;
+            try {
+                split = split_top_level(data, length, std::max(min_segment, length / (threads * 4)), options.parse.validate_utf8, type, segments);
+            }
+            catch (const json_invalid&) {}
+            if (!split || segments.size() < 2) {
+                return parse_from_buffer(data, length, options.parse);
+            }
+
+            std::vector<Node> parts(segments.size());
+            // each segment counts into its own stats, merged once all are done
+            std::vector<ParseStats> part_stats((options.parse.stats)? segments.size() : 0);
+            std::atomic<std::size_t> next_segment(0);
+            std::atomic<bool> failed(false);
+            // the first thing any segment threw, nothing may escape a thread
+            std::mutex error_mutex;
+            std::exception_ptr error;
+            auto work = [&]() {
+                for (std::size_t i = next_segment++; i < segments.size() && !failed; i = next_segment++) {
+                    try {
+                        ParseOptions part_options = options.parse;
+                        if (part_options.stats) part_options.stats = &part_stats[i];
+                        parts[i] = parse_segment(data, segments[i], type, part_options);
+                    }
+                    catch (...) {
+                        std::lock_guard<std::mutex> lock(error_mutex);
+                        if (!error) error = std::current_exception();
+                        failed = true;
+                    }
+                }
+            };
+
+            std::vector<std::thread> workers;
+            const unsigned int helpers = std::min<std::size_t>(threads, segments.size()) - 1;
+            try {
+                for (unsigned int i = 0; i < helpers; i++) {
+                    workers.emplace_back(work);
+                }
+            }
+            catch (...) {
+                failed = true;
+                for (std::thread& worker : workers) worker.join();
+                throw;
+            }
+            work();
+            for (std::thread& worker : workers) worker.join();
+
+            if (error) {
+                try {
+                    std::rethrow_exception(error);
+                }
+                catch (const json_invalid&) {
+                    // offsets and the exact error are only right from the sequential parser
+                    return parse_from_buffer(data, length, options.parse);
+                }
+            }
+
+            if (options.parse.stats) {
+                ParseStats& stats = *options.parse.stats;
+                stats = ParseStats();
+                for (const ParseStats& part : part_stats) stats.merge(part);
+                stats.bytes = length;
+                // every segment built its own copy of the top level container
+                stats.nodes[type] -= std::min(stats.nodes[type], segments.size() - 1);
+            }
+
+            if (type == ARRAY) {
+                std::size_t total = 0;
+                for (const Node& part : parts) total += part.as_array_reference().size();
+                Node::array elements;
+                elements.reserve(total);
+                for (Node& part : parts) {
+                    Node::array& run = part.as_array_mut();
+                    elements.insert(elements.end(), std::make_move_iterator(run.begin()), std::make_move_iterator(run.end()));
+                }
+                return Node(std::move(elements));
+            }
+
+            std::size_t total = 0;
+            for (const Node& part : parts) total += part.as_object_reference().size();
+            Node::object members;
+            members.reserve(total);
+            for (Node& part : parts) {
+                for (Node::object::value_type& member : part.as_object_mut()) {
+                    // a key repeated across segments, which only the whole document can report
+                    if (!members.emplace(member.first, std::move(member.second)).second) {
+                        return parse_from_buffer(data, length, options.parse);
+                    }
+                }
+            }
+            return Node(std::move(members));
+        }
+
+        Node parse_parallel(std::string_view text, const ParallelOptions& options) {
+            return parse_parallel(text.data(), text.size(), options);
+        }
+
+        //= ON DEMAND ========================================
+        std::size_t skip_json_space(const char* data, std::size_t length, std::size_t at) {
+            while (at < length && json_is_space(data[at])) at++;
+            return at;
+        }
+
+        // at is just past the opening quote, returns the offset of the closing one
+        std::size_t skip_json_string(const char* data, std::size_t length, std::size_t at, bool& escaped) {
+            const char* quote = static_cast<const char*>(std::memchr(data + at, QUOTE_CLOSE, length - at));
+            if (quote == nullptr) throw json::unterminated_string();
+
+            std::size_t i = quote - data;
+            escaped = std::memchr(data + at, ESCAPE, i - at) != nullptr;
+            if (!escaped) return i;
+
+            i = at;
+            while (true) {
+                if (i >= length) throw json::unterminated_string();
+                if (data[i] == QUOTE_CLOSE) return i;
+                i += (data[i] == ESCAPE)? 2 : 1;
+            }
+        }
+
+        // Returns the offset just past the value starting at at. Containers
+        // are skipped by counting brackets, their contents aren't checked.
+        std::size_t skip_json_value(const char* data, std::size_t length, std::size_t at) {
+            if (at >= length) throw json::unexpected_end();
+            bool escaped;
+
+            switch (data[at])
+            {
+            case QUOTE_OPEN:
+                return skip_json_string(data, length, at + 1, escaped) + 1;
+
+            case OBJECT_OPEN:
+            case ARRAY_OPEN:
+                {
+                    std::size_t depth = 0;
+                    for (std::size_t i = at; i < length; i++) {
+                        switch (data[i])
+                        {
+                        case QUOTE_OPEN:
+                            i = skip_json_string(data, length, i + 1, escaped);
+                            break;
+                        case OBJECT_OPEN:
+                        case ARRAY_OPEN:
+                            depth++;
+                            break;
+                        case OBJECT_CLOSE:
+                        case ARRAY_CLOSE:
+                            if (--depth == 0) return i + 1;
+                            break;
+                        default:
+                            break;
+                        }
+                    }
+                    throw json::unexpected_end();
+                }
+
+            default:
+                {
+                    std::size_t i = at;
+                    while (i < length && !json_is_space(data[i]) && !json_is_delimeter(data[i]) && data[i] != QUOTE_OPEN) i++;
+                    if (i == at) throw json::missing_definition();
+                    return i;
+                }
+            }
+        }
+
+        LazyValue::LazyValue(const char* d, std::size_t l, std::size_t b) : data(d), length(l), begin(b) {}
+
+        template <typename Visit>
+        void LazyValue::walk(Visit visit) const {
+            const bool is_object = data[begin] == OBJECT_OPEN;
+            const char close = (is_object)? OBJECT_CLOSE : ARRAY_CLOSE;
+
+            std::size_t at = skip_json_space(data, length, begin + 1);
+            if (at < length && data[at] == close) return;
+
+            while (true) {
+                Token key;
+                if (is_object) {
+                    if (at >= length) throw json::unexpected_end();
+                    if (data[at] != QUOTE_OPEN) throw json::wrong_label_type();
+                    key.kind = TOKEN_STRING;
+                    key.begin = at + 1;
+                    key.end = skip_json_string(data, length, key.begin, key.escaped);
+
+                    at = skip_json_space(data, length, key.end + 1);
+                    if (at >= length || data[at] != NAME_SPECIFIER) throw json::missing_label();
+                    at = skip_json_space(data, length, at + 1);
+                }
+
+                if (at >= length) throw json::unexpected_end();
+                if (visit(key, at)) return;
+
+                at = skip_json_space(data, length, skip_json_value(data, length, at));
+                if (at >= length) throw json::unexpected_end();
+                if (data[at] == close) return;
+                if (data[at] != END_PHRASE) throw json::missing_delimeter();
+                at = skip_json_space(data, length, at + 1);
+                // the same grammar as SaxParser, which takes a close after a comma
+                if (JSON_ALLOW_TRAILING_COMMA && at < length && data[at] == close) return;
+            }
+        }
+
+        Token LazyValue::bare_token() const {
+            Token token;
+            token.kind = TOKEN_BARE;
+            token.begin = begin;
+            token.end = skip_json_value(data, length, begin);
+            return token;
+        }
+
+        NodeType LazyValue::get_type() const {
+            if (begin >= length) throw json::unexpected_end();
+            switch (data[begin])
+            {
+            case OBJECT_OPEN:
+                return OBJECT;
+            case ARRAY_OPEN:
+                return ARRAY;
+            case QUOTE_OPEN:
+                return STRING;
+            default:
+                return token_to_node(bare_token(), data).get_type();
+            }
+        }
+
+        bool LazyValue::is_null() const {
+            return get_type() == NONE;
+        }
+
+        std::optional<LazyValue> LazyValue::find(std::string_view key) const {
+            if (get_type() != OBJECT) throw Node::wrong_type();
+
+            std::optional<LazyValue> found;
+            std::string unescaped;
+            walk([&](const Token& label, std::size_t value) {
+                std::string_view text(data + label.begin, label.end - label.begin);
+                if (label.escaped) {
+                    unescaped.clear();
+                    unescape_json_string(text.data(), text.data() + text.size(), unescaped);
+                    text = unescaped;
+                }
+                if (text != key) return false;
+                found.emplace(data, length, value);
+                return true;
+            });
+            return found;
+        }
+
+        LazyValue LazyValue::operator[](std::string_view key) const {
+            const std::optional<LazyValue> found = find(key);
+            if (!found) throw std::out_of_range("LazyValue::operator[]");
+            return *found;
+        }
+
+        LazyValue LazyValue::operator[](std::size_t index) const {
+            if (get_type() != ARRAY) throw Node::wrong_type();
+
+            std::optional<LazyValue> found;
+            std::size_t position = 0;
+            walk([&](const Token&, std::size_t value) {
+                if (position++ != index) return false;
+                found.emplace(data, length, value);
+                return true;
+            });
+            if (!found) throw std::out_of_range("LazyValue::operator[]");
+            return *found;
+        }
+
+        std::size_t LazyValue::size() const {
+            const NodeType type = get_type();
+            if (type != OBJECT && type != ARRAY) throw Node::wrong_type();
+
+            std::size_t count = 0;
+            walk([&](const Token&, std::size_t) {
+                count++;
+                return false;
+            });
+            return count;
+        }
+
+        Node::integer LazyValue::get_int() const {
+            const NodeType type = get_type();
+            if (type != INTEGER && type != REAL) throw Node::coercion_invalid();
+            return token_to_node(bare_token(), data).as_int();
+        }
+
+        Node::real LazyValue::get_real() const {
+            const NodeType type = get_type();
+            if (type != INTEGER && type != REAL) throw Node::coercion_invalid();
+            return token_to_node(bare_token(), data).as_real();
+        }
+
+        std::string LazyValue::get_string() const {
+            if (get_type() != STRING) throw Node::wrong_type();
+
+            Token token;
+            token.begin = begin + 1;
+            token.end = skip_json_string(data, length, token.begin, token.escaped);
+            if (!token.escaped) return std::string(data + token.begin, token.end - token.begin);
+
+            std::string raw;
+            unescape_json_string(data + token.begin, data + token.end, raw);
+            return raw;
+        }
+
+        std::string_view LazyValue::raw() const {
+            return std::string_view(data + begin, skip_json_value(data, length, begin) - begin);
+        }
+
+        Node LazyValue::to_node() const {
+            const std::string_view text = raw();
+            return parse_from_buffer(text.data(), text.size());
+        }
+
+        LazyValue parse_on_demand(const char* data, std::size_t length) {
+            return LazyValue(data, length, skip_json_space(data, length, 0));
+        }
+
+        LazyValue parse_on_demand(std::string_view buffer) {
+            return parse_on_demand(buffer.data(), buffer.size());
+        }
+
+        //= POINTER ==========================================
+        // "0" or digits without a leading zero, anything else (like "-") can only be a key
+        bool pointer_index(std::string_view token, std::size_t& index) {
+            if (token.empty() || token.size() > 19 || (token[0] == '0' && token.size() > 1)) return false;
+            index = 0;
+            for (char c : token) {
+                if (c < '0' || c > '9') return false;
+                index = index * 10 + (c - '0');
+            }
+            return true;
+        }
+
+        Pointer::Pointer(std::string_view text, KeyTable* keys) {
+            if (!text.empty() && text[0] != '/') throw invalid_pointer();
+
+            std::string unescaped;
+            std::vector<std::size_t> ends;
+            for (std::size_t i = 1; i < text.size(); i++) {
+                if (text[i] == '/') {
+                    ends.push_back(unescaped.size());
+                }
+                else if (text[i] != '~') {
+                    unescaped += text[i];
+                }
+                else if (i + 1 < text.size() && (text[i + 1] == '0' || text[i + 1] == '1')) {
+                    unescaped += (text[++i] == '0')? '~' : '/';
+                }
+                else {
+                    throw invalid_pointer();
+                }
+            }
+            if (!text.empty()) ends.push_back(unescaped.size());
+
+            // keys are made once the text has stopped moving
+            tokens = std::make_shared<const std::string>(std::move(unescaped));
+            std::size_t begin = 0;
+            for (std::size_t end : ends) {
+                const std::string_view token(tokens->data() + begin, end - begin);
+                std::size_t index;
+                if (!pointer_index(token, index)) index = NO_INDEX;
+                steps.push_back({(keys)? keys->intern(token) : Key(token), index});
+                begin = end;
+            }
+        }
+
+        const Node* Pointer::step_into(const Node& node, const Step& step) {
+            switch (node.get_type())
+            {
+            case OBJECT: {
+                const Node::object& members = node.as_object_reference();
+                const Node::object::const_iterator found = members.find(step.key);
+                return (found != members.end())? &found->second : nullptr;
+            }
+            case ARRAY: {
+                // "-" and other non indices are NO_INDEX, which is always past the end
+                const Node::array& elements = node.as_array_reference();
+                return (step.index < elements.size())? &elements[step.index] : nullptr;
+            }
+            default:
+                return nullptr;
+            }
+        }
+
+        const Node* Pointer::find(const Node& root) const {
+            const Node* node = &root;
+            for (const Step& step : steps) {
+                node = step_into(*node, step);
+                if (node == nullptr) return nullptr;
+            }
+            return node;
+        }
+
+        Node* Pointer::find(Node& root) const {
+            return const_cast<Node*>(find(static_cast<const Node&>(root)));
+        }
+
+        std::size_t Pointer::size() const {
+            return steps.size();
+        }
+
+        std::string Pointer::to_string() const {
+            std::string text;
+            for (const Step& step : steps) {
+                text += '/';
+                for (char c : step.key.view()) {
+                    if (c == '~') text += "~0";
+                    else if (c == '/') text += "~1";
+                    else text += c;
+                }
+            }
+            return text;
+        }
+
+        std::size_t PointerSet::add(const Pointer& pointer) {
+            std::size_t at = 0;
+            for (const Pointer::Step& step : pointer.steps) {
+                std::size_t next = 0;
+                for (std::size_t child : branches[at].children) {
+                    if (branches[child].step.key == step.key) {
+                        next = child;
+                        break;
+                    }
+                }
+                if (next == 0) {
+                    next = branches.size();
+                    branches.push_back({step, {}, {}});
+                    branches[at].children.push_back(next);
+                }
+                at = next;
+            }
+            branches[at].ends.push_back(pointers.size());
+            pointers.push_back(pointer);
+            return pointers.size() - 1;
+        }
+
+        std::size_t PointerSet::size() const {
+            return pointers.size();
+        }
+
+        void PointerSet::find(const Node& root, std::vector<const Node*>& results) const {
+            results.assign(pointers.size(), nullptr);
+            visit(0, root, results.data());
+        }
+
+        void PointerSet::visit(std::size_t at, const Node& node, const Node** results) const {
+            const Branch& branch = branches[at];
+            for (std::size_t id : branch.ends) results[id] = &node;
+            for (std::size_t child : branch.children) {
+                // everything under a step that leads nowhere stays nullptr
+                if (const Node* next = Pointer::step_into(node, branches[child].step)) visit(child, *next, results);
+            }
+        }
+
+    }
+
+    /*
+        =============================================
+
+                    DOCUMENT SECTION
+
+        =============================================
+    */
+    void* Document::CountingResource::do_allocate(std::size_t bytes, std::size_t alignment) {
+        allocated += bytes;
+    #ifdef SJSON_STATS
+        json::note_allocation(bytes);
+    #endif
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void Document::CountingResource::do_deallocate(void* p, std::size_t bytes, std::size_t alignment) {
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+
+    bool Document::CountingResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+        return this == &other;
+    }
+
+    Document::Document(std::size_t initial_size, KeyTable* shared_keys) : keys(shared_keys) {
+        if (keys == nullptr) {
+            own_keys.reset(new KeyTable());
+            keys = own_keys.get();
+        }
+        if (initial_size > 0) {
+            block.reset(new char[initial_size]);
+            block_size = initial_size;
+        }
+        reset();
+    }
+
+    Document::~Document() {
+        release_tree();
+    }
+
+    void Document::release_tree() {
+        // an untouched tree only holds arena memory, so it is simply forgotten
+        if (has_tree && mutated) {
+            tree.~Node();
+        }
+        has_tree = false;
+        mutated = false;
+    }
+
+    void Document::reset() {
+        release_tree();
+        arena.reset();
+        mapping.reset();
+
+        // grow the kept block by whatever the last parse overflowed into,
+        // so a similar document next time fits without touching the heap
+        if (upstream.allocated > 0) {
+            block_size += upstream.allocated;
+            block.reset(new char[block_size]);
+        }
+        upstream.allocated = 0;
+
+        if (block_size > 0) {
+            arena.emplace(block.get(), block_size, &upstream);
+        }
+        else {
+            arena.emplace(&upstream);
+        }
+    }
+
+    std::size_t Document::arena_overflow() const {
+        return upstream.allocated;
+    }
+
+    const Node& Document::parse(std::string_view text, const json::ParseOptions& options) {
+        reset();
+        json::ParseHelper helper(&*arena, true, keys);
+        json::run_parser(helper, text.data(), text.size(), options);
+        new (&tree) Node(helper.take_root());
+        has_tree = true;
+        return tree;
+    }
+
+    const Node& Document::parse(std::istream& stream, const json::ParseOptions& options) {
+        const std::string buffer = json::read_stream_to_buffer(stream, options.max_bytes);
+        return parse(buffer, options);
+    }
+
+    const Node& Document::load_file(const std::string& path, const json::ParseOptions& options, bool borrow_strings) {
+        reset();
+        mapping.reset(new json::MappedFile(path));
+        const std::string_view bytes = mapping->view();
+        json::ParseHelper helper(&*arena, true, keys, (borrow_strings)? bytes : std::string_view());
+        json::run_parser(helper, bytes.data(), bytes.size(), options);
+        new (&tree) Node(helper.take_root());
+        has_tree = true;
+        return tree;
+    }
+
+    const Node& Document::root() const {
+        static const Node empty;
+        return (has_tree)? tree : empty;
+    }
+
+    Node& Document::root_mut() {
+        if (!has_tree) {
+            new (&tree) Node();
+            has_tree = true;
+        }
+        mutated = true;
+        return tree;
+    }
+
+    /*
+        =============================================
+
+                 MESSAGEPACK SECTION
+    
+        =============================================
+    */
+    namespace messagepack {
+        //= READER ===========================================
+        std::string_view ByteCursor::take_key() {
+            const uint8_t type = take<uint8_t>();
+            if ((type & 0xe0) == 0xa0) return take_bytes(type & 0x1f);
+            switch (type)
+            {
+            case 0xc4:
+            case 0xd9:
+                return take_bytes(take<uint8_t>());
+            case 0xc5:
+            case 0xda:
+                return take_bytes(take<uint16_t>());
+            case 0xc6:
+            case 0xdb:
+                return take_bytes(take<uint32_t>());
+            default:
+                throw messagepack::invalid_key();
+            }
+        }
+
+        bool read_container_header(uint8_t type, ByteCursor& in, std::size_t& count, bool& map) {
+            if ((type & 0xe0) == 0x80) {
+                // fixmap is 0x8X and fixarray 0x9X
+                count = type & 0x0f;
+                map = (type & 0x10) == 0;
+                return true;
+            }
+            switch (type)
+            {
+            case 0xdc:
+            case 0xde:
+                count = in.take<uint16_t>();
+                break;
+            case 0xdd:
+            case 0xdf:
+                count = in.take<uint32_t>();
+                break;
+            default:
+                return false;
+            }
+            map = type >= 0xde;
+            return true;
+        }
+
+        // Handler for read_scalar that sets a node.
+        struct NodeSlot {
+            Node& out;
+
+            void string(std::string_view text) { out = Node(Node::string(text)); }
+            void integer(Node::integer value) { out = Node(value); }
+            void real(Node::real value) { out = Node(value); }
+            // Node has no boolean type, the same as the json parser
+            void boolean(bool value) { out = Node(Node::integer(value)); }
+            void null() { out = Node(); }
+        };
+
+        // Decodes values depth first straight into Nodes. The buffer has to
+        // outlive the reader, nothing is copied until a Node is made.
+        class Reader {
+            public:
+                Reader(const char* data, std::size_t length) : in(data, length) {}
+
+                void read(Node& out, std::size_t depth);
+                std::size_t position() const { return in.position(); }
+
+            private:
+                void read_array(Node& out, std::size_t count, std::size_t depth);
+                void read_map(Node& out, std::size_t count, std::size_t depth);
+
+                ByteCursor in;
+        };
+
+        void Reader::read_array(Node& out, std::size_t count, std::size_t depth) {
+            out = Node(Node::array());
+            Node::array& elements = out.as_array_mut();
+            // every element takes at least a byte, so a lying prefix can't reserve much
+            elements.reserve(std::min(count, in.remaining()));
+            for (std::size_t i = 0; i < count; i++) {
+                read(elements.emplace_back(), depth + 1);
+            }
+        }
+
+        void Reader::read_map(Node& out, std::size_t count, std::size_t depth) {
+            out = Node(Node::object());
+            Node::object& members = out.as_object_mut();
+            members.reserve(std::min(count, in.remaining() / 2));
+            for (std::size_t i = 0; i < count; i++) {
+                const auto added = members.emplace(Key(in.take_key()), Node());
+                if (!added.second) throw messagepack::duplicate_key();
+                read(added.first->second, depth + 1);
+            }
+        }
+
+        void Reader::read(Node& out, std::size_t depth) {
+            const uint8_t type = in.take<uint8_t>();
+            std::size_t count;
+            bool map;
+            if (!read_container_header(type, in, count, map)) {
+                NodeSlot slot{out};
+                read_scalar(type, in, slot);
+                return;
+            }
+
+            if (depth >= MAX_DEPTH) throw messagepack::too_deep();
+            if (map) read_map(out, count, depth);
+            else read_array(out, count, depth);
+        }
+
+        Node parse_from_buffer(const char* data, std::size_t length, std::size_t* used) {
+            Reader reader(data, length);
+            Node root;
+            reader.read(root, 0);
+            if (used) *used = reader.position();
+            else if (reader.position() != length) throw messagepack::trailing_data();
+            return root;
+        }
+
+        Node parse_from_string(std::string_view bytes) {
+            return parse_from_buffer(bytes.data(), bytes.size());
+        }
+
+        Node parse_from_istream(std::istream& stream) {
+            const std::string buffer = json::read_stream_to_buffer(stream);
+            return parse_from_buffer(buffer.data(), buffer.size());
+        }
+
+        //= WRITER ===========================================
+        Packer::Packer(std::string& out, std::size_t size) : out(out), at(out.size()) {
+            out.resize(at + size);
+        }
+
+        Packer::~Packer() {
+            finish();
+        }
+
+        void Packer::finish() {
+            out.resize(at);
+        }
+
+        void Packer::room(std::size_t count) {
+            if (out.size() - at >= count) return;
+            out.resize(std::max(out.size() * 2, at + count));
+        }
+
+        void Packer::put(uint8_t type, uint64_t value, std::size_t bytes) {
+            room(1 + bytes);
+            out[at++] = static_cast<char>(type);
+            for (std::size_t i = bytes; i > 0; i--) {
+                out[at++] = static_cast<char>(value >> (8 * (i - 1)));
+            }
+        }
+
+        // header sizes, shared by encoded_size and the packer's choices
+        std::size_t integer_size(Node::integer value) {
+            if (value >= 0) {
+                if (value <= 0x7f) return 1;
+                if (value <= 0xff) return 2;
+                if (value <= 0xffff) return 3;
+                if (value <= 0xffffffff) return 5;
+                return 9;
+            }
+            if (value >= -32) return 1;
+            if (value >= INT8_MIN) return 2;
+            if (value >= INT16_MIN) return 3;
+            if (value >= INT32_MIN) return 5;
+            return 9;
+        }
+
+        bool fits_float(Node::real value) {
+            return static_cast<double>(static_cast<float>(value)) == value;
+        }
+
+        std::size_t length_header_size(std::size_t count, std::size_t fix_max, bool has_8_bit) {
+            if (count <= fix_max) return 1;
+            if (has_8_bit && count <= 0xff) return 2;
+            if (count <= 0xffff) return 3;
+            if (count <= 0xffffffff) return 5;
+            throw messagepack::too_large();
+        }
+
+        std::size_t encoded_size(const Node& node) {
+            switch (node.get_type())
+            {
+            case INTEGER:
+                return integer_size(node.as_int());
+            case REAL:
+                return (fits_float(node.as_real()))? 5 : 9;
+            case STRING:
+                {
+                    const std::size_t length = node.as_string_view().size();
+                    return length_header_size(length, 31, true) + length;
+                }
+            case ARRAY:
+                {
+                    const Node::array& elements = node.as_array_reference();
+                    std::size_t size = length_header_size(elements.size(), 15, false);
+                    for (const Node& element : elements) size += encoded_size(element);
+                    return size;
+                }
+            case OBJECT:
+                {
+                    const Node::object& members = node.as_object_reference();
+                    std::size_t size = length_header_size(members.size(), 15, false);
+                    for (const auto& member : members) {
+                        size += length_header_size(member.first.size(), 31, true) + member.first.size();
+                        size += encoded_size(member.second);
+                    }
+                    return size;
+                }
+            default:
+                return 1;
+            }
+        }
+
+        void Packer::pack_integer(Node::integer value) {
+            switch (integer_size(value))
+            {
+            case 1:
+                put(static_cast<uint8_t>(value), 0, 0);
+                return;
+            case 2:
+                put((value >= 0)? 0xcc : 0xd0, static_cast<uint64_t>(value), 1);
+                return;
+            case 3:
+                put((value >= 0)? 0xcd : 0xd1, static_cast<uint64_t>(value), 2);
+                return;
+            case 5:
+                put((value >= 0)? 0xce : 0xd2, static_cast<uint64_t>(value), 4);
+                return;
+            default:
+                put((value >= 0)? 0xcf : 0xd3, static_cast<uint64_t>(value), 8);
+                return;
+            }
+        }
+
+        void Packer::pack_real(Node::real value) {
+            if (fits_float(value)) {
+                const float narrow = static_cast<float>(value);
+                uint32_t bits;
+                std::memcpy(&bits, &narrow, sizeof(bits));
+                put(0xca, bits, 4);
+                return;
+            }
+            uint64_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            put(0xcb, bits, 8);
+        }
+
+        void Packer::pack_header(std::size_t count, uint8_t fix_type, std::size_t fix_max, uint8_t wide_type) {
+            if (count <= fix_max) put(static_cast<uint8_t>(fix_type | count), 0, 0);
+            else if (count <= 0xffff) put(wide_type, count, 2);
+            else if (count <= 0xffffffff) put(wide_type + 1, count, 4);
+            else throw messagepack::too_large();
+        }
+
+        void Packer::pack_string(std::string_view text) {
+            if (text.size() > 31 && text.size() <= 0xff) put(0xd9, text.size(), 1);
+            else pack_header(text.size(), 0xa0, 31, 0xda);
+
+            // an empty borrowed string can have a null data pointer
+            if (text.empty()) return;
+            room(text.size());
+            std::memcpy(&out[at], text.data(), text.size());
+            at += text.size();
+        }
+
+        void Packer::pack_boolean(bool value) {
+            put((value)? 0xc3 : 0xc2, 0, 0);
+        }
+
+        void Packer::pack_null() {
+            put(0xc0, 0, 0);
+        }
+
+        std::size_t Packer::pack_open(uint8_t type) {
+            const std::size_t offset = at;
+            put(type, 0, 4);
+            return offset;
+        }
+
+        void Packer::patch_count(std::size_t offset, std::size_t count) {
+            if (count > 0xffffffff) throw messagepack::too_large();
+            for (std::size_t i = 0; i < 4; i++) {
+                out[offset + 4 - i] = static_cast<char>(count >> (8 * i));
+            }
+        }
+
+        void Packer::pack(const Node& node) {
+            switch (node.get_type())
+            {
+            case INTEGER:
+                pack_integer(node.as_int());
+                return;
+            case REAL:
+                pack_real(node.as_real());
+                return;
+            case STRING:
+                pack_string(node.as_string_view());
+                return;
+            case ARRAY:
+                {
+                    const Node::array& elements = node.as_array_reference();
+                    pack_header(elements.size(), 0x90, 15, 0xdc);
+                    for (const Node& element : elements) pack(element);
+                    return;
+                }
+            case OBJECT:
+                {
+                    const Node::object& members = node.as_object_reference();
+                    pack_header(members.size(), 0x80, 15, 0xde);
+                    for (const auto& member : members) {
+                        pack_string(member.first.view());
+                        pack(member.second);
+                    }
+                    return;
+                }
+            default:
+                pack_null();
+                return;
+            }
+        }
+
+        void write(const Node& node, std::string& out, bool exact_size) {
+            Packer packer(out, (exact_size)? encoded_size(node) : 0);
+            packer.pack(node);
+        }
+
+        std::string write(const Node& node, bool exact_size) {
+            std::string out;
+            write(node, out, exact_size);
+            return out;
+        }
+
+        //= TRANSCODING ======================================
+        Encoder::Encoder(std::string& out) : packer(out) {}
+
+        void Encoder::begin_value() {
+            if (!open.empty() && !open.back().map) open.back().count++;
+        }
+
+        void Encoder::start_object() {
+            begin_value();
+            open.push_back({packer.pack_open(0xdf), 0, true});
+        }
+
+        void Encoder::end_object() {
+            packer.patch_count(open.back().header, open.back().count);
+            open.pop_back();
+        }
+
+        void Encoder::start_array() {
+            begin_value();
+            open.push_back({packer.pack_open(0xdd), 0, false});
+        }
+
+        void Encoder::end_array() {
+            packer.patch_count(open.back().header, open.back().count);
+            open.pop_back();
+        }
+
+        void Encoder::key(std::string_view text) {
+            open.back().count++;
+            packer.pack_string(text);
+        }
+
+        void Encoder::string(std::string_view text) {
+            begin_value();
+            packer.pack_string(text);
+        }
+
+        void Encoder::integer(Node::integer value) {
+            begin_value();
+            packer.pack_integer(value);
+        }
+
+        void Encoder::real(Node::real value) {
+            begin_value();
+            packer.pack_real(value);
+        }
+
+        void Encoder::boolean(bool value) {
+            begin_value();
+            packer.pack_boolean(value);
+        }
+
+        void Encoder::null() {
+            begin_value();
+            packer.pack_null();
+        }
+
+        void Encoder::finish() {
+            packer.finish();
+        }
+
+        void from_json(const char* data, std::size_t length, std::string& out, const json::ParseOptions& options) {
+            Encoder encoder(out);
+            json::parse_sax(data, length, encoder, options);
+            encoder.finish();
+        }
+
+        std::string from_json(std::string_view text, const json::ParseOptions& options) {
+            std::string out;
+            from_json(text.data(), text.size(), out, options);
+            return out;
+        }
+
+        void to_json(const char* data, std::size_t length, json::JsonWriter& writer) {
+            messagepack::parse_sax(data, length, writer);
+        }
+
+        std::string to_json(std::string_view bytes, const json::JsonFormat& format) {
+            json::JsonWriter writer(format);
+            to_json(bytes.data(), bytes.size(), writer);
+            return writer.take_output();
+        }
+    } // end of namespace messagepack
+
+}
+
+#endif
+
+#ifdef SJSON_TEST
+
+
+
+#include <gtest/gtest.h>
+using sjson::Node;
+
+// gcc inlines these into new expressions and then warns that free isn't
+// operator delete, which is the point of replacing them
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+// Counts every plain operator new in the test binary, so tests can see
+// how many heap allocations an operation makes. Atomic since some tests
+// run worker threads.
+namespace test_allocations {
+    std::atomic<std::size_t> count(0);
+    std::atomic<std::size_t> bytes(0);
+}
+
+void* operator new(std::size_t size) {
+    test_allocations::count.fetch_add(1, std::memory_order_relaxed);
+    test_allocations::bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* p = std::malloc(size? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+// memory resources allocate through the aligned forms
+void* operator new(std::size_t size, std::align_val_t align) {
+    test_allocations::count.fetch_add(1, std::memory_order_relaxed);
+    test_allocations::bytes.fetch_add(size, std::memory_order_relaxed);
+    const std::size_t alignment = std::max(static_cast<std::size_t>(align), sizeof(void*));
+    const std::size_t rounded = (size + alignment - 1) / alignment * alignment;
+    if (void* p = std::aligned_alloc(alignment, rounded? rounded : alignment)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+TEST(multitype, create_and_equivocate) {
+    Node a((long int)10);
+    ASSERT_EQ(a.as_int(), 10);
+    ASSERT_EQ(a.as_real(), 10.0);
+
+    Node b(7.4);
+    ASSERT_EQ(b.as_real(), 7.4);
+
+    Node c("this is a string");
+    ASSERT_EQ(c.as_string(), "this is a string");
+
+    Node d(Node::array({
+        Node(10l),
+        Node("String"),
+    }));
+
+    Node::array res = d.as_array();
+    ASSERT_EQ(res[0].as_int(), 10);
+    ASSERT_EQ(res[1].as_string(), "String");
+}
+
+TEST(multitype, inline_storage) {
+    // scalars and strings are stored inline, collections by pointer
+    EXPECT_LE(sizeof(Node), sizeof(Node::string) + sizeof(void*));
+
+    Node null_node;
+    EXPECT_EQ(null_node.get_type(), sjson::NONE);
+    EXPECT_EQ(null_node.as_int(), 0);
+    EXPECT_THROW(null_node.as_string(), Node::coercion_invalid);
+
+    Node int_node(42l);
+    EXPECT_EQ(int_node.as_string(), "42");
+    EXPECT_THROW(int_node.as_real_mut(), Node::wrong_type);
+    int_node.as_int_mut() = 7;
+    EXPECT_EQ(int_node.as_real(), 7.0);
+
+    Node str_node("12");
+    EXPECT_EQ(str_node.as_int(), 12);
+    str_node.set_type(sjson::INTEGER);
+    EXPECT_EQ(str_node.get_type(), sjson::INTEGER);
+
+    Node arr_node(Node::array({Node(1l), Node("two")}));
+    Node copy = arr_node;
+    copy.as_array_mut()[0] = Node(3l);
+    EXPECT_EQ(arr_node.as_array_reference()[0].as_int(), 1);
+    EXPECT_THROW(arr_node.as_object_reference(), Node::wrong_type);
+}
+
+TEST(multitype, memory_usage) {
+    EXPECT_EQ(Node(42l).memory_usage(), 0u);
+    EXPECT_EQ(Node("short").memory_usage(), 0u);
+    const std::string text(100, 'x');
+    EXPECT_GE(Node(text).memory_usage(), 101u);
+    EXPECT_EQ(Node::borrow_string(text).memory_usage(), 0u);
+
+    const Node tree = sjson::json::parse_from_string(
+        "{\"list\": [1, 2.5, \"a string long enough to live on the heap\"], \"nested\": {\"k\": [[], {}]}, \"a key long enough to be copied\": null}");
+    EXPECT_GT(tree.memory_usage(), sizeof(Node::object) + 3 * sizeof(Node::object::value_type));
+
+    // a copy allocates exactly what it reports
+    const std::size_t before = test_allocations::bytes;
+    const Node copy = tree;
+    EXPECT_EQ(copy.memory_usage(), test_allocations::bytes - before);
+}
+
+TEST(multitype, move) {
+    static_assert(std::is_nothrow_move_constructible<Node>::value, "Node move must be noexcept");
+    static_assert(std::is_nothrow_move_assignable<Node>::value, "Node move must be noexcept");
+
+    const std::size_t copies_before = sjson::test_counters::deep_copies;
+
+    Node a(Node::array({Node(1l), Node("a string long enough to leave the small buffer")}));
+    Node b(std::move(a));
+    EXPECT_EQ(a.get_type(), sjson::NONE);
+    ASSERT_EQ(b.get_type(), sjson::ARRAY);
+    EXPECT_EQ(b.as_array_reference()[1].as_string_reference(), "a string long enough to leave the small buffer");
+
+    Node c;
+    c = std::move(b);
+    EXPECT_EQ(b.get_type(), sjson::NONE);
+    EXPECT_EQ(c.as_array_reference().size(), 2u);
+
+    // assigning a node from its own child
+    c = std::move(c.as_array_mut()[1]);
+    EXPECT_EQ(c.as_string_reference(), "a string long enough to leave the small buffer");
+
+    Node d;
+    d.set_array(Node::array({Node(2l)}));
+    d.set_object(Node::object({{"k", Node(3l)}}));
+    EXPECT_EQ(d.as_object_reference().at("k").as_int(), 3);
+
+    EXPECT_EQ(sjson::test_counters::deep_copies, copies_before);
+}
+
+TEST(object_map, order_and_lookup) {
+    Node::object small({{"zeta", Node(1l)}, {"alpha", Node(2l)}, {"zeta", Node(3l)}});
+    ASSERT_EQ(small.size(), 2u);
+    EXPECT_EQ(small.begin()->first, "zeta");
+    EXPECT_EQ(small.at("zeta").as_int(), 1);
+
+    // enough members to switch on the hash index
+    Node::object big;
+    for (long i = 0; i < 200; i++) {
+        EXPECT_TRUE(big.emplace("key" + std::to_string(i), Node(i)).second);
+    }
+    EXPECT_FALSE(big.emplace("key17", Node(0l)).second);
+    EXPECT_EQ(big.at("key17").as_int(), 17);
+
+    long expected = 0;
+    for (const auto& member : big) {
+        EXPECT_EQ(member.second.as_int(), expected++);
+    }
+
+    EXPECT_EQ(big.erase("key0"), 1u);
+    EXPECT_EQ(big.erase("key0"), 0u);
+    EXPECT_EQ(big.begin()->first, "key1");
+    EXPECT_EQ(big.count("key199"), 1u);
+    EXPECT_EQ(big.find("missing"), big.end());
+    EXPECT_THROW(big.at("missing"), std::out_of_range);
+
+    big["key5"] = Node("changed");
+    big["new"] = Node(1.5);
+    EXPECT_EQ(big.size(), 200u);
+    EXPECT_EQ(big.at("new").as_real(), 1.5);
+
+    const Node::object copy = big;
+    EXPECT_EQ(copy.at("key5").as_string_reference(), "changed");
+
+    Node parsed = sjson::json::parse_from_string("{\"b\": 1, \"a\": 2, \"c\": {\"y\": 0, \"x\": 1}}");
+    EXPECT_EQ(sjson::json::node_to_json_string(parsed).find("\"b\""), 3u);
+    EXPECT_THROW(sjson::json::parse_from_string("{\"a\": 1, \"a\": 2}"), sjson::json::duplicate_label);
+}
+
+TEST(object_map, interned_keys) {
+    static_assert(sizeof(sjson::Key) == 16, "keys should stay two words");
+
+    sjson::KeyTable keys;
+    const sjson::Key id = keys.intern("id");
+    EXPECT_TRUE(id.is_interned());
+    EXPECT_EQ(keys.intern(std::string("id")).data(), id.data());
+    EXPECT_EQ(keys.find("id").data(), id.data());
+    EXPECT_FALSE(keys.find("name").is_interned());
+    EXPECT_EQ(keys.size(), 1u);
+
+    // past the cap keys still work, they just aren't shared
+    sjson::KeyTable small(2);
+    small.intern("a");
+    small.intern("b");
+    EXPECT_FALSE(small.intern("c").is_interned());
+    EXPECT_TRUE(small.intern("a").is_interned());
+
+    sjson::Document first(0, &keys);
+    sjson::Document second(0, &keys);
+    const Node& a = first.parse("[{\"id\": 1, \"name\": \"x\"}, {\"id\": 2, \"name\": \"y\"}]");
+    const Node& b = second.parse("{\"id\": 3}");
+    const Node::object& a0 = a.as_array_reference()[0].as_object_reference();
+    const Node::object& a1 = a.as_array_reference()[1].as_object_reference();
+    EXPECT_EQ(a0.begin()->first.data(), id.data());
+    EXPECT_EQ(a1.begin()->first.data(), id.data());
+    EXPECT_EQ(b.as_object_reference().begin()->first.data(), id.data());
+    EXPECT_EQ(a1.at(keys.find("name")).as_string_view(), "y");
+    EXPECT_EQ(a1.at("name").as_string_view(), "y");
+
+    // a copy owns its keys, so it can outlive the table
+    const Node::object copy = a0;
+    EXPECT_FALSE(copy.begin()->first.is_interned());
+    EXPECT_EQ(copy.at(id).as_int(), 1);
+
+#ifdef SJSON_MMAP
+    // too long for the length field; the pages are never touched, the length is checked first
+    const std::size_t huge = sjson::Key::MAX_LENGTH + 1;
+    void* pages = ::mmap(nullptr, huge, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    ASSERT_NE(pages, MAP_FAILED);
+    const std::string_view too_long(static_cast<const char*>(pages), huge);
+    EXPECT_THROW(sjson::Key{too_long}, std::length_error);
+    EXPECT_THROW(keys.intern(too_long), std::length_error);
+    EXPECT_THROW(keys.find(too_long), std::length_error);
+    ::munmap(pages, huge);
+#endif
+}
+
+TEST(multitype, to_json) {
+    const Node::array node_array = {Node("my string"), Node((Node::integer)2)};
+    const Node array_node(node_array);
+    const Node::string test_str = "this is a string";
+    const Node::integer test_number = 64;
+    const Node::real test_real = 33.2;
+
+    const Node obj_node = Node((Node::object)
+        {
+            {"my_array", Node(node_array)}, 
+            {"my_string", Node(test_str)},
+            {"my_real" , Node(test_real)},
+            {"my_int", Node(test_number)}
+        });
+
+    std::string as_json = sjson::json::node_to_json_string(obj_node);
+
+    DEBUG_PRINT('\n' << as_json);
+}
+
+TEST(json_writer, formats) {
+    const Node parsed = sjson::json::parse_from_string("{\"a\": [1, 2.5, 3.0], \"b\": {}, \"c\": [], \"s\": \"q\\\"\\n\\u0001\", \"n\": null}");
+
+    const std::string compact = sjson::json::node_to_json_string(parsed, sjson::json::JsonFormat::compact());
+    EXPECT_EQ(compact, "{\"a\":[1,2.5,3.0],\"b\":{},\"c\":[],\"s\":\"q\\\"\\n\\u0001\",\"n\":null}");
+
+    const std::string pretty = sjson::json::node_to_json_string(parsed, sjson::json::JsonFormat::indented(' ', 2));
+    EXPECT_EQ(pretty, "{\n  \"a\": [\n    1,\n    2.5,\n    3.0\n  ],\n  \"b\": {},\n  \"c\": [],\n  \"s\": \"q\\\"\\n\\u0001\",\n  \"n\": null\n}");
+
+    // everything written reads back the same
+    EXPECT_EQ(sjson::json::node_to_json_string(sjson::json::parse_from_string(pretty), sjson::json::JsonFormat::compact()), compact);
+
+    std::string control = "x";
+    control += '\x1f';
+    EXPECT_EQ(sjson::json::node_to_json_string(Node(control)), "\"x\\u001f\"");
+    // an empty borrowed string has no bytes at all
+    EXPECT_EQ(sjson::json::node_to_json_string(Node::borrow_string(std::string_view())), "\"\"");
+
+    // with a sink the output arrives in blocks, not fragments
+    struct CountingSink : sjson::json::JsonSink {
+        std::string out;
+        std::size_t writes = 0;
+        void write(const char* data, std::size_t length) override {
+            out.append(data, length);
+            writes++;
+        }
+    } sink;
+    Node::array big;
+    for (long i = 0; i < 50000; i++) big.push_back(Node(i));
+    sjson::json::JsonWriter writer(sjson::json::JsonFormat::compact(), &sink);
+    writer.write(Node(big));
+    writer.flush();
+    EXPECT_EQ(sink.out, sjson::json::node_to_json_string(Node(big), sjson::json::JsonFormat::compact()));
+    EXPECT_LT(sink.writes, sink.out.size() / 16384);
+
+    // the writer is also a sax handler, so json can be minified without a tree
+    sjson::json::JsonWriter minifier;
+    sjson::json::parse_sax(pretty, minifier);
+    EXPECT_EQ(minifier.output(), compact);
+}
+
+TEST(json_writer, shortest_reals) {
+    const sjson::json::JsonFormat compact = sjson::json::JsonFormat::compact();
+    EXPECT_EQ(sjson::json::node_to_json_string(Node(0.1), compact), "0.1");
+    EXPECT_EQ(sjson::json::node_to_json_string(Node(98.5), compact), "98.5");
+    EXPECT_EQ(sjson::json::node_to_json_string(Node(1e21), compact), "1e+21");
+    EXPECT_EQ(sjson::json::node_to_json_string(Node(-2.0), compact), "-2.0");
+    EXPECT_EQ(sjson::json::node_to_json_string(Node(0.1 + 0.2), compact), "0.30000000000000004");
+    EXPECT_EQ(Node(3.141592653589793).as_string(), "3.141592653589793");
+    EXPECT_EQ(Node(0.25).as_string(), "0.25");
 }
 
 /*
@@ -1375,7 +5795,7 @@ TEST(json_parser, string_translation) {
     }
     {
         const std::string str = "262.848";
-        const float test_value = 262.848;
+        const double test_value = 262.848;
         EXPECT_EQ(sjson::json::parse_str_to_node(str).as_real(), test_value);
     }
     {
@@ -1385,6 +5805,124 @@ TEST(json_parser, string_translation) {
     }
 }
 
+TEST(json_parser, numbers) {
+    Node::integer i = 0;
+    Node::real r = 0;
+    auto parse = [&](std::string_view text) {
+        return sjson::json::parse_number(text.data(), text.data() + text.size(), i, r);
+    };
+
+    EXPECT_EQ(parse("0"), sjson::INTEGER);
+    EXPECT_EQ(parse("-9223372036854775808"), sjson::INTEGER);
+    EXPECT_EQ(i, std::numeric_limits<Node::integer>::min());
+    EXPECT_EQ(parse("9223372036854775807"), sjson::INTEGER);
+    EXPECT_EQ(i, std::numeric_limits<Node::integer>::max());
+
+    // past int64 the value is kept as a real instead of wrapping
+    EXPECT_EQ(parse("9223372036854775808"), sjson::REAL);
+    EXPECT_EQ(r, 9223372036854775808.0);
+    EXPECT_EQ(parse("123456789012345678901234567890"), sjson::REAL);
+    EXPECT_EQ(r, 123456789012345678901234567890.0);
+
+    // doubles round trip exactly, through both the fast and slow paths
+    const double samples[] = {0.1, 98.5, 3.141592653589793, 1e-300, 2.2250738585072014e-308, 1.7976931348623157e308, 0.30000000000000004, 123456.789e-10};
+    for (const double sample : samples) {
+        char text[64];
+        const int length = std::snprintf(text, sizeof(text), "%.17g", sample);
+        EXPECT_EQ(parse(std::string_view(text, length)), sjson::REAL) << text;
+        EXPECT_EQ(r, sample) << text;
+    }
+    EXPECT_EQ(parse("1e5"), sjson::REAL);
+    EXPECT_EQ(r, 100000.0);
+    EXPECT_EQ(parse("-0.000123E+2"), sjson::REAL);
+    EXPECT_EQ(r, -0.0123);
+    EXPECT_EQ(parse("1e400"), sjson::REAL);
+    EXPECT_EQ(r, std::numeric_limits<double>::infinity());
+
+    EXPECT_EQ(parse("null"), sjson::NONE);
+    EXPECT_THROW(parse("01"), sjson::json::invalid_number);
+    EXPECT_THROW(parse("1."), sjson::json::invalid_number);
+    EXPECT_THROW(parse("-"), sjson::json::invalid_number);
+    EXPECT_THROW(parse("1e"), sjson::json::invalid_number);
+    EXPECT_THROW(parse("1.2.3"), sjson::json::invalid_number);
+
+    const Node parsed = sjson::json::parse_from_string("[12345678.9, -7, 2.5e-3]");
+    EXPECT_EQ(parsed.as_array_reference()[0].as_real(), 12345678.9);
+    EXPECT_EQ(parsed.as_array_reference()[1].as_int(), -7);
+    EXPECT_EQ(parsed.as_array_reference()[2].as_real(), 2.5e-3);
+}
+
+// every SimdLevel the running cpu supports, so each code path gets tested
+std::vector<sjson::json::SimdLevel> supported_simd_levels() {
+    std::vector<sjson::json::SimdLevel> levels = {sjson::json::SIMD_NONE};
+    if (sjson::json::detect_simd_level() >= sjson::json::SIMD_SSE2) levels.push_back(sjson::json::SIMD_SSE2);
+    if (sjson::json::detect_simd_level() >= sjson::json::SIMD_AVX2) levels.push_back(sjson::json::SIMD_AVX2);
+    return levels;
+}
+
+// the whole of a file in tests/
+std::string read_test_file(const std::string& name) {
+    std::ifstream file("tests/" + name);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+// Every token from the indexed tokenizer must match the plain buffer tokenizer.
+void expect_same_tokens(const std::string& text, sjson::json::SimdLevel level) {
+    sjson::json::BufferTokenizer plain(text.data(), text.size());
+    sjson::json::IndexedTokenizer indexed(text.data(), text.size(), level);
+
+    sjson::json::Token a, b;
+    bool more = true;
+    while (more) {
+        more = plain.next(a);
+        ASSERT_EQ(indexed.next(b), more);
+        ASSERT_EQ(a.kind, b.kind);
+        ASSERT_EQ(a.begin, b.begin);
+        ASSERT_EQ(a.end, b.end);
+        ASSERT_EQ(a.escaped, b.escaped);
+    }
+}
+
+TEST(json_parser, string_escapes) {
+    auto unescape = [](std::string_view escaped) {
+        std::string raw;
+        sjson::json::unescape_json_string(escaped.data(), escaped.data() + escaped.size(), raw);
+        return raw;
+    };
+    EXPECT_EQ(unescape("a\\tb\\/c\\\\"), "a\tb/c\\");
+    EXPECT_EQ(unescape("caf\\u00e9"), "caf\xc3\xa9");
+    EXPECT_EQ(unescape("\\u20AC"), "\xe2\x82\xac");
+    EXPECT_EQ(unescape("\\ud83d\\ude00!"), "\xf0\x9f\x98\x80!");
+    // a surrogate missing its other half becomes U+FFFD
+    EXPECT_EQ(unescape("\\ud83dx"), "\xef\xbf\xbdx");
+    EXPECT_EQ(unescape("\\ude00"), "\xef\xbf\xbd");
+    EXPECT_THROW(unescape("\\u12g4"), sjson::json::invalid_escape);
+    EXPECT_THROW(unescape("\\u12"), sjson::json::invalid_escape);
+    EXPECT_THROW(unescape("\\x"), sjson::json::invalid_escape);
+
+    // every vector width finds the first byte to escape wherever it is
+    const std::vector<sjson::json::SimdLevel> levels = supported_simd_levels();
+    const std::string special = "\"\\\n\x1f";
+    for (const sjson::json::SimdLevel level : levels) {
+        std::string clean(100, 'a');
+        clean[50] = '\x7f';
+        clean[51] = '\xe9';
+        EXPECT_EQ(sjson::json::find_escape(clean.data(), clean.size(), level), clean.size());
+        for (std::size_t at = 0; at < 70; at++) {
+            for (const char c : special) {
+                std::string text = clean;
+                text[at] = c;
+                EXPECT_EQ(sjson::json::find_escape(text.data(), text.size(), level), at);
+            }
+        }
+    }
+
+    const Node parsed = sjson::json::parse_from_string("[\"line\\nbreak \\u00e9 \\ud83d\\ude00\"]");
+    EXPECT_EQ(sjson::json::node_to_json_string(parsed, sjson::json::JsonFormat::compact()), "[\"line\\nbreak \xc3\xa9 \xf0\x9f\x98\x80\"]");
+}
+
 // todo: write json export for debugging visuals
 
 TEST(json_parser, tokenizer) {
@@ -1422,6 +5960,910 @@ TEST(json_parser, basic_file) {
 
 }
 
+TEST(json_parser, parse_without_copies) {
+    const std::string test_str = "{\"a\":[1,[2,[3,{\"b\":[4]}]]],\"c\":{\"d\":{\"e\":[]}}}";
+    auto stream_proto = std::istringstream(test_str);
+
+    const std::size_t copies_before = sjson::test_counters::deep_copies;
+    Node parsed = sjson::json::parse_from_istream(stream_proto);
+    EXPECT_EQ(sjson::test_counters::deep_copies, copies_before);
+
+    const Node& deepest = parsed.as_object_reference().at("a").as_array_reference()[1]
+        .as_array_reference()[1].as_array_reference()[1];
+    EXPECT_EQ(deepest.as_object_reference().at("b").as_array_reference()[0].as_int(), 4);
+}
+
+TEST(json_parser, buffer_tokenizer) {
+    const std::string test_str = "{fortnite ,balls  \t \n\n  : \"i'm   }\"gay I,like]boys";
+    sjson::json::BufferTokenizer tokenizer(test_str.data(), test_str.size());
+
+    const std::vector<std::pair<sjson::json::TokenKind, std::string>> expected = {
+        {sjson::json::TOKEN_OBJECT_OPEN, "{"},
+        {sjson::json::TOKEN_BARE, "fortnite"},
+        {sjson::json::TOKEN_END_PHRASE, ","},
+        {sjson::json::TOKEN_BARE, "balls"},
+        {sjson::json::TOKEN_NAME_SPECIFIER, ":"},
+        {sjson::json::TOKEN_STRING, "i'm   }"},
+        {sjson::json::TOKEN_BARE, "gay"},
+        {sjson::json::TOKEN_BARE, "I"},
+        {sjson::json::TOKEN_END_PHRASE, ","},
+        {sjson::json::TOKEN_BARE, "like"},
+        {sjson::json::TOKEN_ARRAY_CLOSE, "]"},
+        {sjson::json::TOKEN_BARE, "boys"},
+    };
+
+    sjson::json::Token token;
+    for (const auto& e : expected) {
+        ASSERT_TRUE(tokenizer.next(token));
+        EXPECT_EQ(token.kind, e.first);
+        EXPECT_EQ(test_str.substr(token.begin, token.end - token.begin), e.second);
+    }
+    EXPECT_FALSE(tokenizer.next(token));
+    EXPECT_EQ(token.kind, sjson::json::TOKEN_END);
+}
+
+TEST(json_parser, parse_from_string) {
+    const std::string test_str = "{\"list\": [1, 2.5, \"three\", null], \"esc\": \"a\\\"b\\\\c\\n\"}";
+    Node parsed = sjson::json::parse_from_string(test_str);
+
+    const Node::array& list = parsed.as_object_reference().at("list").as_array_reference();
+    ASSERT_EQ(list.size(), 4u);
+    EXPECT_EQ(list[0].as_int(), 1);
+    EXPECT_EQ(list[1].as_real(), 2.5);
+    EXPECT_EQ(list[2].as_string_reference(), "three");
+    EXPECT_EQ(list[3].get_type(), sjson::NONE);
+    EXPECT_EQ(parsed.as_object_reference().at("esc").as_string_reference(), "a\"b\\c\n");
+
+    // the istream path buffers and goes through the same parser
+    std::istringstream stream(test_str);
+    Node from_stream = sjson::json::parse_from_istream(stream);
+    EXPECT_EQ(sjson::json::node_to_json_string(from_stream), sjson::json::node_to_json_string(parsed));
+
+    EXPECT_EQ(sjson::json::parse_from_string("  -17 ").as_int(), -17);
+    EXPECT_THROW(sjson::json::parse_from_string("{\"open\": \"never closed"), sjson::json::unterminated_string);
+    EXPECT_THROW(sjson::json::parse_from_string("[1, [2]"), sjson::json::unexpected_end);
+    EXPECT_THROW(sjson::json::parse_from_string("[1}"), sjson::json::wrong_closer);
+}
+
+TEST(json_parser, structural_index) {
+    std::vector<std::string> inputs = {
+        "{fortnite ,balls  \t \n\n  : \"i'm   }\"gay I,like]boys",
+        "{\"basic\":123}",
+        "",
+        "   ",
+        "\"\\\\\"",
+        "[\"\\\\\\\"\", \"\\\\\\\\\"]",
+    };
+
+    inputs.push_back(read_test_file("all_types.json"));
+
+    // strings full of quotes and backslash runs landing on every offset of
+    // a block, long enough to span several index chunks
+    {
+        uint32_t seed = 12345;
+        auto next_random = [&seed]() { seed = seed * 1103515245 + 12345; return (seed >> 16) & 0x7fff; };
+        const char alphabet[] = "ab\"\\ \n{}[]:,";
+
+        std::string doc = "[";
+        while (doc.size() < 200000) {
+            doc += "\"";
+            const unsigned len = next_random() % 40;
+            for (unsigned i = 0; i < len; i++) {
+                const char c = alphabet[next_random() % (sizeof(alphabet) - 1)];
+                if (c == '"' || c == '\\') doc += '\\';
+                doc += c;
+            }
+            doc += "\"";
+            doc += std::string(next_random() % 3, ' ');
+            doc += ", " + std::to_string(next_random()) + " ,";
+        }
+        doc += "0]";
+        inputs.push_back(doc);
+    }
+
+    const std::vector<sjson::json::SimdLevel> levels = supported_simd_levels();
+
+    for (const auto level : levels) {
+        for (const std::string& input : inputs) {
+            expect_same_tokens(input, level);
+        }
+    }
+
+    const Node parsed = sjson::json::parse_from_string(inputs.back());
+    EXPECT_GT(parsed.as_array_reference().size(), 1000u);
+}
+
+TEST(json_parser, utf8_validation) {
+    sjson::json::ParseOptions validate;
+    validate.validate_utf8 = true;
+
+    const std::vector<sjson::json::SimdLevel> levels = supported_simd_levels();
+
+    // offset of the first bad sequence, or -1 if the text is valid
+    auto first_invalid = [](const std::string& text, sjson::json::SimdLevel level) -> long {
+        sjson::json::IndexedTokenizer tokenizer(text.data(), text.size(), level, true);
+        sjson::json::Token token;
+        try {
+            while (tokenizer.next(token)) {}
+        }
+        catch (sjson::json::invalid_utf8& e) {
+            return e.offset;
+        }
+        return -1;
+    };
+
+    const std::string valid_text = "\"a\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80 \xef\xbf\xbd \xf4\x8f\xbf\xbf\"";
+    const std::vector<std::string> invalid = {
+        "\xc0\x80",           // overlong
+        "\xe0\x9f\xbf",       // overlong three byte
+        "\xed\xa0\x80",       // surrogate
+        "\xf4\x90\x80\x80",   // past U+10FFFF
+        "\xf5\x80\x80\x80",
+        "\x80",               // stray continuation
+        "\xe2\x82",           // cut short by the closing quote
+    };
+
+    for (const auto level : levels) {
+        // sequences straddling every position of a block boundary
+        for (std::size_t pad = 0; pad < 70; pad++) {
+            const std::string prefix = "\"" + std::string(pad, 'x');
+            EXPECT_EQ(first_invalid(prefix + valid_text.substr(1), level), -1);
+            for (const std::string& bad : invalid) {
+                EXPECT_EQ(first_invalid(prefix + bad + "\"", level), long(prefix.size())) << pad;
+            }
+        }
+        // the buffer ending partway through a sequence
+        EXPECT_EQ(first_invalid("\"ab\xf0\x9f", level), 3);
+    }
+
+    const std::string bad_document = "{\"name\": \"caf\xc3\"}";
+    EXPECT_NO_THROW(sjson::json::parse_from_string(bad_document));
+    EXPECT_THROW(sjson::json::parse_from_string(bad_document, validate), sjson::json::invalid_utf8);
+    EXPECT_EQ(sjson::json::parse_from_string("[" + valid_text + "]", validate).as_array_reference()[0].as_string_view(), valid_text.substr(1, valid_text.size() - 2));
+}
+
+// what a parse produced, compact json or the name of what it threw
+template <typename Parse>
+std::string parse_outcome(Parse parse) {
+    try {
+        return sjson::json::node_to_json_string(parse(), sjson::json::JsonFormat::compact());
+    }
+    catch (sjson::json::json_invalid& e) {
+        return std::string("threw ") + typeid(e).name();
+    }
+}
+
+TEST(json_parser, push_parser) {
+    std::vector<std::string> documents = {
+        "{\"a\": [1, -2.5e-3, \"x\\\\\\\"y\\u00e9\\ud83d\\ude00\", null, true], \"b\": {\"c\": {}}, \"d\": []}",
+        "  12345678901234567890  ",
+        "\"lone \\\\ string\"",
+        "-0.125",
+        "[1, 2",
+        "{\"open\": \"never closed",
+        "[1}",
+        "{\"a\" 1}",
+    };
+    documents.push_back(read_test_file("all_types.json"));
+    {
+        std::string big = "[";
+        for (int i = 0; i < 3000; i++) {
+            big += "{\"id\": " + std::to_string(i * 7919) + ", \"v\": " + std::to_string(i / 7.0) + ", \"s\": \"a\\\\n\\\\\\\"b\\\\u0041\"},";
+        }
+        big += "null]";
+        documents.push_back(big);
+    }
+
+    for (const std::string& document : documents) {
+        const std::string whole = parse_outcome([&]() { return sjson::json::parse_from_string(document); });
+
+        // every split point at once: one byte per feed
+        const std::string bytewise = parse_outcome([&]() {
+            sjson::json::DomBuilder builder;
+            sjson::json::PushParser<sjson::json::DomBuilder> parser(builder);
+            for (const char& c : document) parser.feed(&c, 1);
+            parser.finish();
+            return builder.take_root();
+        });
+        EXPECT_EQ(bytewise, whole) << document.substr(0, 80);
+
+        const std::string chunked = parse_outcome([&]() {
+            sjson::json::DomBuilder builder;
+            sjson::json::PushParser<sjson::json::DomBuilder> parser(builder);
+            for (std::size_t at = 0; at < document.size(); at += 1000) {
+                // each piece is a copy that dies after the feed, like a socket buffer
+                const std::string piece = document.substr(at, 1000);
+                parser.feed(piece);
+            }
+            parser.finish();
+            return builder.take_root();
+        });
+        EXPECT_EQ(chunked, whole) << document.substr(0, 80);
+    }
+
+    // utf-8 is checked across pieces, a byte at a time
+    sjson::json::ParseOptions validate;
+    validate.validate_utf8 = true;
+    const auto feed_bytewise = [&](const std::string& document) {
+        sjson::json::DomBuilder builder;
+        sjson::json::PushParser<sjson::json::DomBuilder> parser(builder, validate);
+        for (const char& c : document) parser.feed(&c, 1);
+        parser.finish();
+        return builder.take_root();
+    };
+    EXPECT_EQ(feed_bytewise("[\"caf\xc3\xa9 \xf0\x9f\x98\x80\"]").as_array_reference()[0].as_string(), "caf\xc3\xa9 \xf0\x9f\x98\x80");
+    try {
+        feed_bytewise("[\"caf\xc3\xa9\", \"\xe2\x82\"]");
+        ADD_FAILURE() << "a cut off sequence was accepted";
+    }
+    catch (const sjson::json::invalid_utf8& error) {
+        EXPECT_EQ(error.offset, 11u);
+    }
+    EXPECT_THROW(feed_bytewise("[\"\xc0\xaf\"]"), sjson::json::invalid_utf8);
+    EXPECT_THROW(feed_bytewise("1 \xc3"), sjson::json::invalid_utf8);
+    // without the option bytes aren't checked, as with parse_from_*
+    sjson::json::DomBuilder builder;
+    sjson::json::PushParser<sjson::json::DomBuilder> unchecked(builder);
+    unchecked.feed("[\"\xc0\xaf\"]");
+    unchecked.finish();
+    EXPECT_TRUE(unchecked.done());
+}
+
+TEST(json_parser, parse_lines) {
+    std::string text;
+    for (int i = 0; i < 2000; i++) {
+        if (i % 100 == 7) text += "{\"id\": " + std::to_string(i) + ",\n";
+        else if (i % 100 == 8) text += "   \r\n";
+        else text += "{\"id\": " + std::to_string(i) + ", \"name\": \"n\\u00e9\"}\r\n";
+    }
+    // last line without a newline
+    text += "[\"end\"]";
+
+    const auto collect = [&](const sjson::json::LinesOptions& options) {
+        std::vector<std::string> results;
+        sjson::json::parse_lines(text,
+            [&](std::size_t line, Node&& record) {
+                results.push_back(std::to_string(line) + " " + sjson::json::node_to_json_string(record, sjson::json::JsonFormat::compact()));
+            },
+            [&](std::size_t line, std::exception_ptr error) {
+                try { std::rethrow_exception(error); }
+                catch (const sjson::json::json_invalid&) { results.push_back(std::to_string(line) + " error"); }
+            },
+            options);
+        return results;
+    };
+
+    sjson::json::LinesOptions sequential;
+    sequential.threads = 1;
+    const std::vector<std::string> expected = collect(sequential);
+    ASSERT_EQ(expected.size(), 1981u);
+    EXPECT_EQ(expected[0], "1 {\"id\":0,\"name\":\"n\xc3\xa9\"}");
+    EXPECT_EQ(expected[7], "8 error");
+    EXPECT_EQ(expected[8], "10 {\"id\":9,\"name\":\"n\xc3\xa9\"}");
+    EXPECT_EQ(expected.back(), "2001 [\"end\"]");
+
+    // small batches and a tight in flight limit, so workers wait on delivery
+    sjson::json::LinesOptions parallel;
+    parallel.threads = 4;
+    parallel.batch_bytes = 100;
+    parallel.batches_in_flight = 3;
+    EXPECT_EQ(collect(parallel), expected);
+
+    // a throwing callback stops the batch and reaches the caller
+    std::size_t seen = 0;
+    EXPECT_THROW(sjson::json::parse_lines(text,
+        [&](std::size_t, Node&&) { if (++seen == 50) throw std::runtime_error("stop"); },
+        [](std::size_t, std::exception_ptr) {},
+        parallel), std::runtime_error);
+    EXPECT_EQ(seen, 50u);
+
+    std::size_t calls = 0;
+    sjson::json::parse_lines("", [&](std::size_t, Node&&) { calls++; }, [&](std::size_t, std::exception_ptr) { calls++; });
+    EXPECT_EQ(calls, 0u);
+}
+
+TEST(json_parser, parse_parallel) {
+    std::string array = "  [";
+    std::string object = "{";
+    for (int i = 0; i < 500; i++) {
+        // brackets and commas inside strings must not split anything
+        const std::string element = "{\"id\": " + std::to_string(i) + ", \"tag\": \"],[\\\"{,}\", \"v\": [" + std::to_string(i / 3.0) + ", null, [true]]}";
+        array += element + ((i < 499)? ", " : "");
+        object += "\"k" + std::to_string(i) + "\": " + element + ((i < 499)? ",\n" : "");
+    }
+    array += "]  ";
+    object += "}";
+
+    sjson::json::ParallelOptions options;
+    options.threads = 4;
+    options.min_segment_bytes = 256;
+
+    std::vector<std::string> documents = {
+        array,
+        object,
+        "[]",
+        "12345",
+        // errors anywhere have to match the sequential parser's
+        array.substr(0, array.size() - 3),
+        array.substr(0, 4000) + ",," + array.substr(4000),
+        object.substr(0, object.size() - 1) + ", \"k3\": 1}",
+        array.substr(0, array.size() - 3) + ",]",
+    };
+    for (const std::string& document : documents) {
+        const std::string sequential = parse_outcome([&]() { return sjson::json::parse_from_string(document); });
+        const std::string parallel = parse_outcome([&]() { return sjson::json::parse_parallel(document, options); });
+        EXPECT_EQ(parallel, sequential) << document.substr(0, 80);
+    }
+
+    // malformed utf-8 between two top level elements, and after the last
+    // one where no segment reaches
+    sjson::json::ParallelOptions validating = options;
+    validating.parse.validate_utf8 = true;
+    const std::size_t comma = array.find(", ", 4000) + 1;
+    for (const std::string& document : {
+            array.substr(0, comma) + "\xff" + array.substr(comma),
+            array.substr(0, comma) + "\xc0\xaf" + array.substr(comma),
+            array + "\xff"}) {
+        const std::string sequential = parse_outcome([&]() { return sjson::json::parse_from_string(document, validating.parse); });
+        const std::string parallel = parse_outcome([&]() { return sjson::json::parse_parallel(document, validating); });
+        EXPECT_EQ(sequential, std::string("threw ") + typeid(sjson::json::invalid_utf8).name());
+        EXPECT_EQ(parallel, sequential);
+    }
+
+    const Node parsed = sjson::json::parse_parallel(array, options);
+    EXPECT_EQ(parsed.as_array_reference().size(), 500u);
+    EXPECT_EQ(parsed.as_array_reference()[499].as_object_reference().at("id").as_int(), 499);
+}
+
+// the counters are only compiled in with SJSON_STATS
+#ifdef SJSON_STATS
+TEST(json_parser, parse_stats) {
+    const std::string text = "{\"a\": [1, 2.5, \"x\", null, true], \"b\": {\"c\": \"a string too long to be stored inline\"}}";
+    sjson::json::ParseStats stats;
+    sjson::json::ParseOptions options;
+    options.stats = &stats;
+    sjson::json::parse_from_string(text, options);
+
+    EXPECT_EQ(stats.bytes, text.size());
+    EXPECT_EQ(stats.tokens, 23u);
+    EXPECT_EQ(stats.nodes[sjson::OBJECT], 2u);
+    EXPECT_EQ(stats.nodes[sjson::ARRAY], 1u);
+    EXPECT_EQ(stats.nodes[sjson::STRING], 2u);
+    EXPECT_EQ(stats.nodes[sjson::INTEGER], 2u);
+    EXPECT_EQ(stats.nodes[sjson::REAL], 1u);
+    EXPECT_EQ(stats.nodes[sjson::NONE], 1u);
+    EXPECT_EQ(stats.max_depth, 2u);
+    EXPECT_GT(stats.allocations, 0u);
+    EXPECT_GE(stats.allocated_bytes, 39u);
+    EXPECT_GT(stats.total_ns, 0u);
+    EXPECT_EQ(stats.tokenize_ns + stats.build_ns, stats.total_ns);
+
+    // a document's arena counts the heap it takes, not the block it starts with
+    sjson::Document document(64);
+    document.parse(text, options);
+    EXPECT_EQ(stats.tokens, 23u);
+    EXPECT_GT(stats.allocations, 0u);
+    EXPECT_EQ(stats.allocated_bytes, document.arena_overflow());
+
+    struct Tracer : sjson::json::ParseTracer {
+        std::vector<std::size_t> started;
+        std::vector<std::size_t> tokens;
+        void parse_started(std::size_t bytes) override { started.push_back(bytes); }
+        void parse_finished(const sjson::json::ParseStats& s) override { tokens.push_back(s.tokens); }
+    } tracer;
+
+    // one parse in two is sampled, failures included
+    sjson::json::set_parse_tracer(&tracer, 2);
+    sjson::json::parse_from_string("[1]");
+    sjson::json::parse_from_string("[1, 2]");
+    EXPECT_THROW(sjson::json::parse_from_string("[1, 2, 3"), sjson::json::json_invalid);
+    sjson::json::parse_from_string("[1, 2, 3, 4]");
+    sjson::json::set_parse_tracer(nullptr);
+    sjson::json::parse_from_string("[1, 2, 3, 4, 5]");
+
+    EXPECT_EQ(tracer.started, std::vector<std::size_t>({3, 8}));
+    EXPECT_EQ(tracer.tokens, std::vector<std::size_t>({3, 6}));
+
+    // the threaded parsers count per worker and add the parts up
+    std::string lines;
+    std::string array = "[";
+    for (int i = 0; i < 500; i++) {
+        lines += "{\"id\": " + std::to_string(i) + ", \"tags\": [\"x\", 1.5]}\n";
+        array += "{\"id\": " + std::to_string(i) + ", \"tags\": [\"x\", 1.5]},";
+    }
+    array += "null]";
+
+    sjson::json::LinesOptions lines_options;
+    lines_options.threads = 2;
+    lines_options.batch_bytes = 1000;
+    lines_options.parse.stats = &stats;
+    sjson::json::parse_lines(lines, [](std::size_t, Node&&) {}, [](std::size_t, std::exception_ptr) {}, lines_options);
+    EXPECT_EQ(stats.nodes[sjson::OBJECT], 500u);
+    EXPECT_EQ(stats.nodes[sjson::ARRAY], 500u);
+    EXPECT_EQ(stats.nodes[sjson::INTEGER], 500u);
+    EXPECT_EQ(stats.tokens, 500u * 13);
+    EXPECT_EQ(stats.bytes, lines.size() - 500);
+    EXPECT_EQ(stats.max_depth, 2u);
+
+    sjson::json::ParseStats sequential;
+    options.stats = &sequential;
+    sjson::json::parse_from_string(array, options);
+    sjson::json::ParallelOptions parallel;
+    parallel.threads = 2;
+    parallel.min_segment_bytes = 1000;
+    parallel.parse.stats = &stats;
+    sjson::json::parse_parallel(array, parallel);
+    for (int type = sjson::NONE; type <= sjson::OBJECT; type++) EXPECT_EQ(stats.nodes[type], sequential.nodes[type]) << type;
+    EXPECT_EQ(stats.max_depth, sequential.max_depth);
+    EXPECT_EQ(stats.bytes, array.size());
+    EXPECT_EQ(stats.tokenize_ns + stats.build_ns, stats.total_ns);
+}
+#endif
+
+TEST(json_parser, parse_limits) {
+    const std::string text = "{\"a\": [1, [2, [3]]], \"b\": \"four\", \"c\": \"\\u0041\\u0042\"}";
+    sjson::json::ParseOptions options;
+    options.max_bytes = text.size();
+    options.max_nodes = 9;
+    options.max_depth = 4;
+    options.max_string_length = 4;
+    EXPECT_EQ(sjson::json::parse_from_string(text, options).as_object_reference().size(), 3u);
+
+    // each limit one short of the document
+    sjson::json::ParseOptions bytes;
+    bytes.max_bytes = text.size() - 1;
+    EXPECT_THROW(sjson::json::parse_from_string(text, bytes), sjson::json::too_many_bytes);
+    std::istringstream stream(std::string(1 << 20, ' ') + text);
+    EXPECT_THROW(sjson::json::parse_from_istream(stream, bytes), sjson::json::too_many_bytes);
+
+    sjson::json::ParseOptions nodes;
+    nodes.max_nodes = 8;
+    EXPECT_THROW(sjson::json::parse_from_string(text, nodes), sjson::json::too_many_nodes);
+
+    sjson::json::ParseOptions depth;
+    depth.max_depth = 3;
+    EXPECT_THROW(sjson::json::parse_from_string(text, depth), sjson::json::too_deep);
+    EXPECT_THROW(sjson::json::parse_from_string(std::string(100000, '['), depth), sjson::json::too_deep);
+
+    // strings are measured unescaped, keys too
+    sjson::json::ParseOptions length;
+    length.max_string_length = 3;
+    EXPECT_THROW(sjson::json::parse_from_string(text, length), sjson::json::string_too_long);
+    EXPECT_NO_THROW(sjson::json::parse_from_string("[\"\\u0041\\u0042\"]", length));
+    EXPECT_THROW(sjson::json::parse_from_string("{\"long key\": 1}", length), sjson::json::limit_exceeded);
+
+    // the same limits hold for every way in
+    sjson::json::SaxHandler ignore;
+    EXPECT_THROW(sjson::json::parse_sax(text, ignore, depth), sjson::json::too_deep);
+    sjson::Document document;
+    EXPECT_THROW(document.parse(text, nodes), sjson::json::too_many_nodes);
+    EXPECT_EQ(document.parse(text, options).as_object_reference().size(), 3u);
+    const auto feed_chunked = [&](const sjson::json::ParseOptions& limits) {
+        sjson::json::DomBuilder builder;
+        sjson::json::PushParser<sjson::json::DomBuilder> parser(builder, limits);
+        for (std::size_t at = 0; at < text.size(); at += 5) parser.feed(text.substr(at, 5));
+        parser.finish();
+        return builder.take_root();
+    };
+    EXPECT_EQ(feed_chunked(options).as_object_reference().size(), 3u);
+    EXPECT_THROW(feed_chunked(bytes), sjson::json::too_many_bytes);
+    EXPECT_THROW(feed_chunked(nodes), sjson::json::too_many_nodes);
+    EXPECT_THROW(feed_chunked(depth), sjson::json::too_deep);
+    EXPECT_THROW(feed_chunked(length), sjson::json::string_too_long);
+
+    // a string cut across pieces is stopped before its closing quote comes
+    const auto feed_open_string = [](const std::string& piece, std::size_t pieces) {
+        sjson::json::SaxHandler ignore;
+        sjson::json::ParseOptions limits;
+        limits.max_string_length = 64;
+        sjson::json::PushParser<sjson::json::SaxHandler> parser(ignore, limits);
+        parser.feed("[\"");
+        for (std::size_t i = 0; i < pieces; i++) parser.feed(piece);
+    };
+    EXPECT_NO_THROW(feed_open_string("ab", 32));
+    EXPECT_THROW(feed_open_string("ab", 1000), sjson::json::string_too_long);
+    EXPECT_NO_THROW(feed_open_string("\\u0041", 64));
+    EXPECT_THROW(feed_open_string("\\u0041", 1000), sjson::json::string_too_long);
+    sjson::json::ParallelOptions parallel;
+    parallel.threads = 2;
+    parallel.min_segment_bytes = 1;
+    parallel.parse = length;
+    EXPECT_THROW(sjson::json::parse_parallel(text, parallel), sjson::json::string_too_long);
+}
+
+TEST(json_parser, on_demand) {
+    std::string text = "{\"skip\": [[1, \"]\"], {\"x\": \"}\"}], \"user\": {\"name\": \"a\\\"b\", \"id\": 42}, \"list\": [1.5, null, \"s\"]}";
+    // a big subtree in front that should only be skipped
+    text.insert(1, "\"payload\": [" + std::string(20000, ' ') + "{\"deep\": [[[[]]]]}],");
+
+    const sjson::json::LazyValue root = sjson::json::parse_on_demand(text);
+    EXPECT_EQ(root.get_type(), sjson::OBJECT);
+    EXPECT_EQ(root.size(), 4u);
+
+    const std::size_t before = test_allocations::count;
+    EXPECT_EQ(root["user"]["id"].get_int(), 42);
+    EXPECT_EQ(root["list"][0].get_real(), 1.5);
+    EXPECT_EQ(test_allocations::count - before, 0u);
+
+    EXPECT_EQ(root["user"]["name"].get_string(), "a\"b");
+    EXPECT_TRUE(root["list"][1].is_null());
+    EXPECT_EQ(root["list"][2].get_string(), "s");
+    EXPECT_EQ(root["skip"].raw(), "[[1, \"]\"], {\"x\": \"}\"}]");
+    EXPECT_FALSE(root.find("missing").has_value());
+    EXPECT_THROW(root["missing"], std::out_of_range);
+    EXPECT_THROW(root["list"][3], std::out_of_range);
+    EXPECT_THROW(root["list"][2].get_int(), Node::coercion_invalid);
+    EXPECT_THROW(root["list"]["key"], Node::wrong_type);
+
+    // any subtree can still be turned into a full node
+    const Node user = root["user"].to_node();
+    EXPECT_EQ(user.as_object_reference().at("id").as_int(), 42);
+    EXPECT_EQ(sjson::json::node_to_json_string(root.to_node()), sjson::json::node_to_json_string(sjson::json::parse_from_string(text)));
+
+    // trailing commas are taken just like the DOM parser takes them
+    const sjson::json::LazyValue trailing_array = sjson::json::parse_on_demand("[1,]");
+    EXPECT_EQ(trailing_array.size(), 1u);
+    EXPECT_EQ(trailing_array[0].get_int(), 1);
+    EXPECT_THROW(trailing_array[1], std::out_of_range);
+    EXPECT_EQ(sjson::json::parse_from_string("[1,]").as_array_reference().size(), 1u);
+    const sjson::json::LazyValue trailing_object = sjson::json::parse_on_demand("{\"a\":1,}");
+    EXPECT_EQ(trailing_object.size(), 1u);
+    EXPECT_EQ(trailing_object["a"].get_int(), 1);
+    EXPECT_FALSE(trailing_object.find("b").has_value());
+    EXPECT_EQ(sjson::json::parse_from_string("{\"a\":1,}").as_object_reference().size(), 1u);
+}
+
+// records events as text, called directly through the template
+struct EventLog {
+    std::string log;
+    void start_object() { log += "{"; }
+    void end_object() { log += "}"; }
+    void start_array() { log += "["; }
+    void end_array() { log += "]"; }
+    void key(std::string_view k) { log += std::string(k) + ":"; }
+    void string(std::string_view s) { log += "s(" + std::string(s) + ")"; }
+    void integer(Node::integer i) { log += "i(" + std::to_string(i) + ")"; }
+    void real(Node::real) { log += "r"; }
+    void boolean(bool b) { log += (b)? "T" : "F"; }
+    void null() { log += "n"; }
+};
+
+TEST(json_parser, pointer) {
+    // the examples from RFC 6901 section 5
+    const Node document = sjson::json::parse_from_string(
+        "{\"foo\": [\"bar\", \"baz\"], \"\": 0, \"a/b\": 1, \"c%d\": 2, \"e^f\": 3, \"g|h\": 4, \"i\\\\j\": 5, \"k\\\"l\": 6, \" \": 7, \"m~n\": 8}");
+    const auto at = [&](std::string_view text) { return sjson::json::Pointer(text).find(document); };
+    EXPECT_EQ(at(""), &document);
+    EXPECT_EQ(at("/foo"), &document.as_object_reference().at("foo"));
+    EXPECT_EQ(at("/foo/0")->as_string(), "bar");
+    EXPECT_EQ(at("/")->as_int(), 0);
+    EXPECT_EQ(at("/a~1b")->as_int(), 1);
+    EXPECT_EQ(at("/c%d")->as_int(), 2);
+    EXPECT_EQ(at("/i\\j")->as_int(), 5);
+    EXPECT_EQ(at("/k\"l")->as_int(), 6);
+    EXPECT_EQ(at("/ ")->as_int(), 7);
+    EXPECT_EQ(at("/m~0n")->as_int(), 8);
+
+    // missing members, past the end, leading zeros and steps into scalars
+    EXPECT_EQ(at("/missing"), nullptr);
+    EXPECT_EQ(at("/foo/2"), nullptr);
+    EXPECT_EQ(at("/foo/-"), nullptr);
+    EXPECT_EQ(at("/foo/01"), nullptr);
+    EXPECT_EQ(at("/foo/0/x"), nullptr);
+    EXPECT_EQ(sjson::json::Pointer("/0").find(sjson::json::parse_from_string("{\"0\": 1}"))->as_int(), 1);
+
+    EXPECT_THROW(sjson::json::Pointer("foo"), sjson::json::invalid_pointer);
+    EXPECT_THROW(sjson::json::Pointer("/a~2"), sjson::json::invalid_pointer);
+    EXPECT_THROW(sjson::json::Pointer("/a~"), sjson::json::invalid_pointer);
+    EXPECT_EQ(sjson::json::Pointer("/a~1b/m~0n/").to_string(), "/a~1b/m~0n/");
+    EXPECT_EQ(sjson::json::Pointer("/a~1b/m~0n/").size(), 3u);
+
+    // compiled once, looked up without allocating
+    const sjson::json::Pointer pointer("/foo/1");
+    const std::size_t before = test_allocations::count;
+    EXPECT_EQ(pointer.find(document)->as_string(), "baz");
+    EXPECT_EQ(test_allocations::count - before, 0u);
+
+    Node mutable_document = document;
+    pointer.find(mutable_document)->set_string("qux");
+    EXPECT_EQ(mutable_document.as_object_reference().at("foo").as_array_reference()[1].as_string(), "qux");
+
+    // keys interned in a document's table
+    sjson::KeyTable keys;
+    sjson::Document shared(0, &keys);
+    shared.parse("{\"user\": {\"name\": \"ada\", \"tags\": [\"x\", \"y\"]}}");
+    EXPECT_EQ(sjson::json::Pointer("/user/name", &keys).find(shared.root())->as_string(), "ada");
+
+    // a batch shares the "/user" step, and a failed step ends everything under it
+    sjson::json::PointerSet set;
+    EXPECT_EQ(set.add(sjson::json::Pointer("/user/name", &keys)), 0u);
+    set.add(sjson::json::Pointer("/user/tags/1"));
+    set.add(sjson::json::Pointer("/user"));
+    set.add(sjson::json::Pointer("/user/name/first"));
+    set.add(sjson::json::Pointer("/nobody/name"));
+    set.add(sjson::json::Pointer("/user/name", &keys));
+    EXPECT_EQ(set.size(), 6u);
+
+    std::vector<const Node*> results;
+    set.find(shared.root(), results);
+    ASSERT_EQ(results.size(), 6u);
+    EXPECT_EQ(results[0]->as_string(), "ada");
+    EXPECT_EQ(results[1]->as_string(), "y");
+    EXPECT_EQ(results[2], &shared.root().as_object_reference().at("user"));
+    EXPECT_EQ(results[3], nullptr);
+    EXPECT_EQ(results[4], nullptr);
+    EXPECT_EQ(results[5], results[0]);
+
+    const std::size_t again = test_allocations::count;
+    set.find(shared.root(), results);
+    EXPECT_EQ(test_allocations::count - again, 0u);
+}
+
+TEST(json_parser, sax_events) {
+    EventLog events;
+    sjson::json::parse_sax("{\"a\": [1, 2.5, \"x\\ty\"], \"b\": {\"c\": null}, \"d\": true, \"e\": false}", events);
+    EXPECT_EQ(events.log, "{a:[i(1)rs(x\ty)]b:{c:n}d:Te:F}");
+
+    // only counting, through the virtual interface
+    struct CountIntegers : sjson::json::SaxHandler {
+        long sum = 0;
+        void integer(Node::integer i) override { sum += i; }
+    } counter;
+    sjson::json::SaxHandler& handler = counter;
+    sjson::json::parse_sax("[1, [2, {\"k\": 3}], \"4\"]", handler);
+    EXPECT_EQ(counter.sum, 6);
+
+    EventLog ignored;
+    EXPECT_THROW(sjson::json::parse_sax("{\"a\" 1}", ignored), sjson::json::missing_delimeter);
+    EXPECT_THROW(sjson::json::parse_sax("{1: 2}", ignored), sjson::json::missing_label);
+    EXPECT_THROW(sjson::json::parse_sax("[\"a\": 1]", ignored), sjson::json::label_in_array);
+    EXPECT_THROW(sjson::json::parse_sax("{\"a\":}", ignored), sjson::json::missing_definition);
+    EXPECT_THROW(sjson::json::parse_sax("1, 2", ignored), sjson::json::wrong_delimeter);
+    EXPECT_THROW(sjson::json::parse_sax("[1", ignored), sjson::json::unexpected_end);
+
+    // the dom builder is just another handler, booleans come out as integers
+    const Node parsed = sjson::json::parse_from_string("{\"flag\": true, \"list\": [[], {}]}");
+    EXPECT_EQ(parsed.as_object_reference().at("flag").as_int(), 1);
+    EXPECT_EQ(parsed.as_object_reference().at("list").as_array_reference().size(), 2u);
+}
+
+std::string packed(std::initializer_list<int> bytes) {
+    std::string out;
+    for (int byte : bytes) out.push_back(static_cast<char>(byte));
+    return out;
+}
+
+TEST(messagepack, reader) {
+    const auto json_of = [](const std::string& bytes) {
+        return sjson::json::node_to_json_string(sjson::messagepack::parse_from_string(bytes), sjson::json::JsonFormat::compact());
+    };
+
+    // fixint, negative fixint, nil, false, true
+    EXPECT_EQ(json_of(packed({0x95, 0x05, 0x7f, 0xe0, 0xff, 0xc0})), "[5,127,-32,-1,null]");
+    EXPECT_EQ(json_of(packed({0x92, 0xc2, 0xc3})), "[0,1]");
+    // uint 8 to 64, with the last one too big for an int64
+    EXPECT_EQ(json_of(packed({0x94, 0xcc, 0xff, 0xcd, 0x01, 0x00, 0xce, 0xff, 0xff, 0xff, 0xff,
+        0xcf, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff})), "[255,256,4294967295,18446744073709551616.0]");
+    // int 8 to 64
+    EXPECT_EQ(json_of(packed({0x94, 0xd0, 0x80, 0xd1, 0xff, 0x00, 0xd2, 0x80, 0x00, 0x00, 0x00,
+        0xd3, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00})), "[-128,-256,-2147483648,-9223372036854775808]");
+    // float 32 and 64
+    EXPECT_EQ(json_of(packed({0x92, 0xca, 0x3f, 0xc0, 0x00, 0x00, 0xcb, 0x3f, 0xb9, 0x99, 0x99, 0x99, 0x99, 0x99, 0x9a})), "[1.5,0.1]");
+    // fixstr, str 8/16/32 and bin 8
+    EXPECT_EQ(json_of(packed({0x95, 0xa2, 'h', 'i', 0xd9, 0x01, 'a', 0xda, 0x00, 0x01, 'b',
+        0xdb, 0x00, 0x00, 0x00, 0x01, 'c', 0xc4, 0x02, 'd', 'e'})), "[\"hi\",\"a\",\"b\",\"c\",\"de\"]");
+    // fixmap, map 16, array 16 and 32 nested
+    EXPECT_EQ(json_of(packed({0x82, 0xa1, 'a', 0xdc, 0x00, 0x01, 0xdd, 0x00, 0x00, 0x00, 0x00,
+        0xa1, 'b', 0xde, 0x00, 0x01, 0xc4, 0x01, 'c', 0x80})), "{\"a\":[[]],\"b\":{\"c\":{}}}");
+
+    std::string long_string = packed({0xda, 0x01, 0x2c}) + std::string(300, 'x');
+    EXPECT_EQ(sjson::messagepack::parse_from_string(long_string).as_string(), std::string(300, 'x'));
+
+    // several values back to back
+    const std::string stream = packed({0x01, 0xa1, 'z', 0x90});
+    std::size_t at = 0;
+    std::vector<std::string> values;
+    while (at < stream.size()) {
+        std::size_t used = 0;
+        values.push_back(sjson::json::node_to_json_string(sjson::messagepack::parse_from_buffer(stream.data() + at, stream.size() - at, &used), sjson::json::JsonFormat::compact()));
+        at += used;
+    }
+    EXPECT_EQ(values, std::vector<std::string>({"1", "\"z\"", "[]"}));
+
+    std::istringstream file(packed({0x81, 0xa2, 'i', 'd', 0x2a}));
+    EXPECT_EQ(sjson::messagepack::parse_from_istream(file).as_object_reference().at("id").as_int(), 42);
+
+    EXPECT_THROW(sjson::messagepack::parse_from_string(""), sjson::messagepack::unexpected_end);
+    EXPECT_THROW(sjson::messagepack::parse_from_string(packed({0x92, 0x01})), sjson::messagepack::unexpected_end);
+    EXPECT_THROW(sjson::messagepack::parse_from_string(packed({0xa5, 'a'})), sjson::messagepack::unexpected_end);
+    // an array claiming four billion elements must not reserve for them
+    EXPECT_THROW(sjson::messagepack::parse_from_string(packed({0xdd, 0xff, 0xff, 0xff, 0xff, 0x01})), sjson::messagepack::unexpected_end);
+    EXPECT_THROW(sjson::messagepack::parse_from_string(packed({0xc1})), sjson::messagepack::unsupported_type);
+    EXPECT_THROW(sjson::messagepack::parse_from_string(packed({0xd4, 0x01, 0x00})), sjson::messagepack::unsupported_type);
+    EXPECT_THROW(sjson::messagepack::parse_from_string(packed({0x81, 0x01, 0x02})), sjson::messagepack::invalid_key);
+    EXPECT_THROW(sjson::messagepack::parse_from_string(packed({0x82, 0xa1, 'a', 0x01, 0xa1, 'a', 0x02})), sjson::messagepack::duplicate_key);
+    EXPECT_THROW(sjson::messagepack::parse_from_string(packed({0x01, 0x02})), sjson::messagepack::trailing_data);
+    EXPECT_THROW(sjson::messagepack::parse_from_string(std::string(5000, '\x91')), sjson::messagepack::too_deep);
+}
+
+TEST(messagepack, writer) {
+    const auto bytes_of = [](const Node& node) { return sjson::messagepack::write(node); };
+
+    // the smallest form at each boundary
+    EXPECT_EQ(bytes_of(Node(Node::integer(127))), packed({0x7f}));
+    EXPECT_EQ(bytes_of(Node(Node::integer(128))), packed({0xcc, 0x80}));
+    EXPECT_EQ(bytes_of(Node(Node::integer(65535))), packed({0xcd, 0xff, 0xff}));
+    EXPECT_EQ(bytes_of(Node(Node::integer(65536))), packed({0xce, 0x00, 0x01, 0x00, 0x00}));
+    EXPECT_EQ(bytes_of(Node(Node::integer(1ll << 32))), packed({0xcf, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00}));
+    EXPECT_EQ(bytes_of(Node(Node::integer(-32))), packed({0xe0}));
+    EXPECT_EQ(bytes_of(Node(Node::integer(-33))), packed({0xd0, 0xdf}));
+    EXPECT_EQ(bytes_of(Node(Node::integer(-129))), packed({0xd1, 0xff, 0x7f}));
+    EXPECT_EQ(bytes_of(Node(Node::integer(-32769))), packed({0xd2, 0xff, 0xff, 0x7f, 0xff}));
+    EXPECT_EQ(bytes_of(Node(std::numeric_limits<Node::integer>::min())), packed({0xd3, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}));
+    EXPECT_EQ(bytes_of(Node(1.5)), packed({0xca, 0x3f, 0xc0, 0x00, 0x00}));
+    EXPECT_EQ(bytes_of(Node(0.1)), packed({0xcb, 0x3f, 0xb9, 0x99, 0x99, 0x99, 0x99, 0x99, 0x9a}));
+    EXPECT_EQ(bytes_of(Node::borrow_string(std::string_view())), packed({0xa0}));
+    EXPECT_EQ(bytes_of(Node()), packed({0xc0}));
+    EXPECT_EQ(bytes_of(Node(std::string(31, 'a'))), packed({0xbf}) + std::string(31, 'a'));
+    EXPECT_EQ(bytes_of(Node(std::string(32, 'a'))), packed({0xd9, 0x20}) + std::string(32, 'a'));
+    EXPECT_EQ(bytes_of(Node(std::string(256, 'a'))), packed({0xda, 0x01, 0x00}) + std::string(256, 'a'));
+    EXPECT_EQ(bytes_of(Node(std::string(70000, 'a'))).substr(0, 5), packed({0xdb, 0x00, 0x01, 0x11, 0x70}));
+    EXPECT_EQ(bytes_of(Node(Node::array(15))).substr(0, 1), packed({0x9f}));
+    EXPECT_EQ(bytes_of(Node(Node::array(16))).substr(0, 3), packed({0xdc, 0x00, 0x10}));
+    EXPECT_EQ(bytes_of(Node(Node::array(70000))).substr(0, 5), packed({0xdd, 0x00, 0x01, 0x11, 0x70}));
+    EXPECT_EQ(bytes_of(Node(Node::object{{"k", Node(Node::integer(1))}})), packed({0x81, 0xa1, 'k', 0x01}));
+
+    std::ifstream file("tests/all_types.json");
+    Node::array mixed = {sjson::json::parse_from_istream(file)};
+    Node::object wide;
+    for (int i = 0; i < 40; i++) {
+        wide.emplace("key " + std::to_string(i), Node(Node::integer(i * 1000003)));
+    }
+    mixed.push_back(Node(std::move(wide)));
+    mixed.push_back(Node(-1e300));
+    const Node document(std::move(mixed));
+
+    std::string streamed = "prefix";
+    sjson::messagepack::write(document, streamed);
+    const std::size_t before = test_allocations::count;
+    const std::string exact = sjson::messagepack::write(document, true);
+    // sized first, so the output is one allocation
+    EXPECT_EQ(test_allocations::count - before, 1u);
+    EXPECT_EQ(streamed, "prefix" + exact);
+    EXPECT_EQ(exact.size(), sjson::messagepack::encoded_size(document));
+
+    // everything reads back to the same tree
+    const auto json = [](const Node& node) { return sjson::json::node_to_json_string(node, sjson::json::JsonFormat::compact()); };
+    EXPECT_EQ(json(sjson::messagepack::parse_from_string(exact)), json(document));
+}
+
+TEST(messagepack, transcoding) {
+    // container headers are 32 bit so their counts can be filled in afterwards
+    EXPECT_EQ(sjson::messagepack::from_json("[1, \"a\", {\"k\": true}]"),
+        packed({0xdd, 0x00, 0x00, 0x00, 0x03, 0x01, 0xa1, 'a', 0xdf, 0x00, 0x00, 0x00, 0x01, 0xa1, 'k', 0xc3}));
+
+    EventLog events;
+    sjson::messagepack::parse_sax(packed({0x83, 0xa1, 'a', 0x92, 0x01, 0xca, 0x3f, 0xc0, 0x00, 0x00,
+        0xa1, 'b', 0x81, 0xc4, 0x01, 'c', 0xc0, 0xa1, 'd', 0x92, 0xc3, 0x90}), events);
+    EXPECT_EQ(events.log, "{a:[i(1)r]b:{c:n}d:[T[]]}");
+
+    const std::string text = "[" + read_test_file("all_types.json") + ", {\"flags\": [true, false, null], \"big\": 12345678901234567890, \"neg\": -40000}]";
+
+    // json to messagepack reads back as the same tree
+    const std::string bytes = sjson::messagepack::from_json(text);
+    const auto json = [](const Node& node) { return sjson::json::node_to_json_string(node, sjson::json::JsonFormat::compact()); };
+    EXPECT_EQ(json(sjson::messagepack::parse_from_string(bytes)), json(sjson::json::parse_from_string(text)));
+
+    // and the round trip keeps booleans, which a tree can't
+    sjson::json::JsonWriter direct(sjson::json::JsonFormat::compact());
+    sjson::json::parse_sax(text, direct);
+    EXPECT_EQ(sjson::messagepack::to_json(bytes), direct.output());
+
+    // only the output and the nesting stack allocate, however many values there are
+    std::string many = "[";
+    for (int i = 0; i < 5000; i++) many += "{\"id\": " + std::to_string(i) + ", \"tags\": [\"x\", \"y\"]},";
+    many += "null]";
+    std::string out;
+    out.reserve(many.size());
+    const std::size_t before = test_allocations::count;
+    sjson::messagepack::from_json(many.data(), many.size(), out);
+    EXPECT_LT(test_allocations::count - before, 10u);
+
+    // fed in pieces through a push parser
+    std::string pieces;
+    {
+        sjson::messagepack::Encoder encoder(pieces);
+        sjson::json::PushParser<sjson::messagepack::Encoder> parser(encoder);
+        for (std::size_t at = 0; at < text.size(); at += 7) parser.feed(std::string_view(text).substr(at, 7));
+        parser.finish();
+        encoder.finish();
+    }
+    EXPECT_EQ(pieces, bytes);
+}
+
+TEST(document, arena_allocations) {
+    std::string text = "[";
+    for (int i = 0; i < 1000; i++) {
+        text += "{\"id\": " + std::to_string(i) + ", \"name\": \"item\", "
+            "\"description\": \"a string long enough to need its own allocation\", "
+            "\"tags\": [1.5, null, \"x\"]},";
+    }
+    text += "{}]";
+
+    std::size_t before = test_allocations::count;
+    const Node heap_tree = sjson::json::parse_from_string(text);
+    const std::size_t heap_allocations = test_allocations::count - before;
+
+    sjson::Document document;
+    before = test_allocations::count;
+    const Node& tree = document.parse(text);
+    const std::size_t arena_allocations = test_allocations::count - before;
+
+    // the same document parsed again reuses the arena from last time
+    before = test_allocations::count;
+    document.parse(text);
+    const std::size_t reused_allocations = test_allocations::count - before;
+
+    EXPECT_GT(heap_allocations, 5000u);
+    EXPECT_LT(arena_allocations, 64u);
+    EXPECT_LT(reused_allocations, 16u);
+    EXPECT_EQ(document.arena_overflow(), 0u);
+
+    EXPECT_EQ(sjson::json::node_to_json_string(tree), sjson::json::node_to_json_string(heap_tree));
+
+    const Node& first = tree.as_array_reference()[0];
+    EXPECT_EQ(first.as_object_reference().at("description").as_string_view(), "a string long enough to need its own allocation");
+    EXPECT_THROW(first.as_object_reference().at("description").as_string_reference(), Node::wrong_type);
+
+    // copies own their data and outlive the document
+    Node copy = tree.as_array_reference()[1];
+    document.reset();
+    EXPECT_EQ(document.root().get_type(), sjson::NONE);
+    EXPECT_EQ(copy.as_object_reference().at("description").as_string_reference(), "a string long enough to need its own allocation");
+    EXPECT_EQ(copy.as_object_reference().at("tags").as_array_reference()[2].as_string_reference(), "x");
+
+    // mutated trees fall back to normal destruction
+    document.parse(text);
+    document.root_mut().as_array_mut().push_back(Node("a heap string that the arena does not own"));
+    EXPECT_EQ(document.root().as_array_reference().size(), 1002u);
+}
+
+TEST(document, load_file) {
+    std::string text = "{\"escaped\": \"a\\nb\", \"plain\": [";
+    for (int i = 0; i < 100; i++) text += "\"" + std::string(1000, 'a' + i % 26) + "\", ";
+    text += "\"\"]}";
+    const std::string path = testing::TempDir() + "sjson_load_file.json";
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << text;
+    }
+
+    const std::string expected = sjson::json::node_to_json_string(sjson::json::parse_from_string(text), sjson::json::JsonFormat::compact());
+    EXPECT_EQ(sjson::json::node_to_json_string(sjson::json::from_file_path(path), sjson::json::JsonFormat::compact()), expected);
+
+    // copied, the strings alone overflow a small arena
+    sjson::Document document(1024);
+    document.load_file(path, sjson::json::ParseOptions(), false);
+    EXPECT_EQ(sjson::json::node_to_json_string(document.root(), sjson::json::JsonFormat::compact()), expected);
+    EXPECT_GE(document.arena_overflow(), 100000u);
+
+    // borrowed, only the containers and the escaped string take arena memory
+    sjson::Document borrowing(1024);
+    const Node& root = borrowing.load_file(path);
+    EXPECT_EQ(sjson::json::node_to_json_string(root, sjson::json::JsonFormat::compact()), expected);
+    EXPECT_LT(borrowing.arena_overflow(), 20000u);
+    EXPECT_EQ(root.as_object_reference().at("escaped").as_string_view(), "a\nb");
+
+    // a copy owns its strings and outlives the mapping
+    const Node copy = root;
+    borrowing.reset();
+    EXPECT_EQ(sjson::json::node_to_json_string(copy, sjson::json::JsonFormat::compact()), expected);
+
+    std::remove(path.c_str());
+    EXPECT_THROW(sjson::json::from_file_path(path), std::system_error);
+    EXPECT_THROW(borrowing.load_file(path), std::system_error);
+}
+
 #include <fstream>
 // this crashes, todo
 TEST(json_parser, all_types) {
@@ -1435,4 +6877,642 @@ int main() {
     return RUN_ALL_TESTS();
 }
 
-#endif
\ No newline at end of file
+#endif
+
+#ifdef SJSON_BENCH
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <atomic>
+using sjson::Node;
+
+// results are stored here so the optimizer can't drop the work behind them
+volatile std::size_t bench_sink = 0;
+
+// Best throughput of a few runs of fn over bytes of json, in MB/s.
+template <typename Fn>
+double bench_mb_per_s(std::size_t bytes, Fn fn) {
+    double best = 0;
+    for (int run = 0; run < 5; run++) {
+        const auto start = std::chrono::steady_clock::now();
+        fn();
+        const std::chrono::duration<double> taken = std::chrono::steady_clock::now() - start;
+        best = std::max(best, bytes / taken.count() / 1e6);
+    }
+    return best;
+}
+
+// count records like {"id": i, "name": "user name i"} with whatever members
+// extra(i) adds, in one array or one per line
+std::string make_records_text(int count, const std::function<std::string(int)>& extra, bool as_lines = false) {
+    std::string text = (as_lines)? "" : "[";
+    for (int i = 0; i < count; i++) {
+        text += "{\"id\": " + std::to_string(i) + ", \"name\": \"user name " + std::to_string(i) + "\"" + extra(i) + "}";
+        text += (as_lines)? "\n" : ", ";
+    }
+    if (!as_lines) text += "null]";
+    return text;
+}
+
+std::string scores_member(int i) {
+    return ", \"scores\": [" + std::to_string(i / 7.0) + ", " + std::to_string(i % 13) + "]";
+}
+
+//= SUITE ==============================================
+// Every operation over every corpus, with allocations counted. Corpora
+// are generated from a fixed seed using only the raw engine output, so
+// they are the same bytes on every run and standard library.
+
+// gcc inlines these into new expressions and then warns that free isn't
+// operator delete, which is the point of replacing them
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+namespace bench_allocations {
+    std::atomic<std::size_t> count(0);
+}
+
+void* operator new(std::size_t size) {
+    bench_allocations::count.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void* operator new(std::size_t size, std::align_val_t align) {
+    bench_allocations::count.fetch_add(1, std::memory_order_relaxed);
+    const std::size_t alignment = std::max(static_cast<std::size_t>(align), sizeof(void*));
+    const std::size_t rounded = (size + alignment - 1) / alignment * alignment;
+    if (void* p = std::aligned_alloc(alignment, rounded? rounded : alignment)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+// One or more json documents under a name.
+struct Corpus {
+    std::string name;
+    std::vector<std::string> documents;
+
+    std::size_t bytes() const {
+        std::size_t total = 0;
+        for (const std::string& document : documents) total += document.size();
+        return total;
+    }
+};
+
+// a number below limit from the raw engine output
+uint64_t bench_pick(std::mt19937_64& random, uint64_t limit) {
+    return random() % limit;
+}
+
+std::string bench_word(std::mt19937_64& random, std::size_t length) {
+    std::string word;
+    for (std::size_t i = 0; i < length; i++) word.push_back(static_cast<char>('a' + bench_pick(random, 26)));
+    return word;
+}
+
+Corpus make_numbers_corpus() {
+    std::mt19937_64 random(1);
+    std::string text = "[";
+    char digits[32];
+    for (int i = 0; i < 300000; i++) {
+        if (i > 0) text += ", ";
+        if (i % 2 == 0) {
+            text += std::to_string(static_cast<int64_t>(bench_pick(random, 2000000000)) - 1000000000);
+        }
+        else {
+            const double value = (static_cast<double>(bench_pick(random, 2000000)) - 1000000) / 1024.0 * ((i % 3 == 0)? 1e-6 : 1e3);
+            text.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+        }
+    }
+    text += "]";
+    return {"numbers", {text}};
+}
+
+Corpus make_nested_corpus() {
+    std::mt19937_64 random(2);
+    std::string text = "[";
+    for (int copy = 0; copy < 2000; copy++) {
+        if (copy > 0) text += ", ";
+        const std::size_t depth = 32 + bench_pick(random, 32);
+        for (std::size_t level = 0; level < depth; level++) {
+            text += (level % 2 == 0)? "{\"" + bench_word(random, 4) + "\": " : "[" + std::to_string(level) + ", ";
+        }
+        text += "null";
+        for (std::size_t level = depth; level > 0; level--) {
+            text += ((level - 1) % 2 == 0)? "}" : "]";
+        }
+    }
+    text += "]";
+    return {"nested", {text}};
+}
+
+Corpus make_logs_corpus() {
+    std::mt19937_64 random(3);
+    static const char* levels[] = {"debug", "info", "warning", "error"};
+    std::string text = "[";
+    for (int i = 0; i < 3000; i++) {
+        if (i > 0) text += ",\n";
+        std::string message;
+        const std::size_t words = 30 + bench_pick(random, 300);
+        for (std::size_t w = 0; w < words; w++) {
+            message += bench_word(random, 1 + bench_pick(random, 9));
+            // the odd escape, as in quoted values, stack traces and names
+            switch (bench_pick(random, 40))
+            {
+            case 0: message += "\\n"; break;
+            case 1: message += " \\\"quoted\\\" "; break;
+            case 2: message += " caf\\u00e9 "; break;
+            default: message += ' '; break;
+            }
+        }
+        text += "{\"time\": \"2024-05-0" + std::to_string(1 + i % 9) + "T12:00:00Z\", \"level\": \"" + levels[bench_pick(random, 4)]
+            + "\", \"service\": \"" + bench_word(random, 8) + "\", \"message\": \"" + message + "\"}";
+    }
+    text += "]";
+    return {"logs", {text}};
+}
+
+Corpus make_small_documents_corpus() {
+    std::mt19937_64 random(4);
+    Corpus corpus{"small_documents", {}};
+    for (int i = 0; i < 40000; i++) {
+        corpus.documents.push_back("{\"id\": " + std::to_string(i) + ", \"ok\": " + ((bench_pick(random, 2) == 0)? "true" : "false")
+            + ", \"user\": \"" + bench_word(random, 6) + "\", \"tags\": [\"" + bench_word(random, 3) + "\", \"" + bench_word(random, 5) + "\"], \"score\": "
+            + std::to_string(bench_pick(random, 1000)) + "." + std::to_string(bench_pick(random, 100)) + "}");
+    }
+    return corpus;
+}
+
+Corpus make_twitter_corpus() {
+    std::mt19937_64 random(5);
+    std::string text = "{\"statuses\": [";
+    for (int i = 0; i < 6000; i++) {
+        if (i > 0) text += ", ";
+        const std::string id = std::to_string(505874924095815681ull + bench_pick(random, 1000000000));
+        const std::string name = bench_word(random, 4 + bench_pick(random, 8));
+        const std::string tag = bench_word(random, 3 + bench_pick(random, 6));
+        std::string words;
+        for (int w = 0; w < 12; w++) words += bench_word(random, 2 + bench_pick(random, 6)) + " ";
+
+        text += "{\"metadata\": {\"result_type\": \"recent\", \"iso_language_code\": \"ja\"}, "
+            "\"created_at\": \"Sun Aug 31 00:29:15 +0000 2014\", \"id\": " + id + ", \"id_str\": \"" + id + "\", "
+            "\"text\": \"@" + name + " " + words + "#" + tag + " \\u65e5\\u672c\\u8a9e\", "
+            "\"source\": \"<a href=\\\"https://mobile.example.com\\\" rel=\\\"nofollow\\\">Mobile Web</a>\", \"truncated\": false, "
+            "\"in_reply_to_status_id\": null, \"in_reply_to_screen_name\": " + ((i % 3 == 0)? "\"" + name + "\"" : "null") + ", "
+            "\"user\": {\"id\": " + std::to_string(bench_pick(random, 3000000000ull)) + ", \"name\": \"" + name + "\", \"screen_name\": \"" + name + "_\", "
+            "\"location\": \"\", \"description\": \"" + words + "\", \"url\": null, \"protected\": false, "
+            "\"followers_count\": " + std::to_string(bench_pick(random, 100000)) + ", \"friends_count\": " + std::to_string(bench_pick(random, 5000)) + ", "
+            "\"created_at\": \"Sun Mar 29 13:03:36 +0000 2009\", \"utc_offset\": 32400, \"verified\": false, \"lang\": \"ja\", "
+            "\"profile_image_url\": \"http://pbs.example.com/profile_images/" + std::to_string(bench_pick(random, 1000000)) + "/" + name + "_normal.jpeg\"}, "
+            "\"geo\": null, \"coordinates\": null, \"place\": null, \"retweet_count\": " + std::to_string(bench_pick(random, 500)) + ", "
+            "\"favorite_count\": " + std::to_string(bench_pick(random, 500)) + ", "
+            "\"entities\": {\"hashtags\": [{\"text\": \"" + tag + "\", \"indices\": [" + std::to_string(bench_pick(random, 50)) + ", " + std::to_string(50 + bench_pick(random, 50)) + "]}], "
+            "\"symbols\": [], \"urls\": [], \"user_mentions\": [{\"screen_name\": \"" + name + "\", \"id\": " + std::to_string(bench_pick(random, 3000000000ull)) + ", \"indices\": [0, 8]}]}, "
+            "\"favorited\": false, \"retweeted\": false, \"lang\": \"ja\"}";
+    }
+    text += "], \"search_metadata\": {\"completed_in\": 0.087, \"max_id\": 505874924095815681, \"count\": 6000, \"since_id\": 0}}";
+    return {"twitter", {text}};
+}
+
+struct BenchResult {
+    std::string corpus;
+    std::string operation;
+    double speed;
+    // MB/s of the corpus text, or million operations a second
+    const char* unit;
+    // heap allocations made by one run
+    std::size_t allocations;
+};
+
+// Best of five timed runs, with prepare run untimed before each.
+template <typename Prepare, typename Run>
+BenchResult bench_measure(const std::string& corpus, const char* operation, double work, const char* unit, Prepare prepare, Run run) {
+    BenchResult result{corpus, operation, 0, unit, 0};
+    for (int repeat = 0; repeat < 5; repeat++) {
+        prepare();
+        const std::size_t before = bench_allocations::count.load();
+        const auto start = std::chrono::steady_clock::now();
+        run();
+        const std::chrono::duration<double> taken = std::chrono::steady_clock::now() - start;
+        result.allocations = bench_allocations::count.load() - before;
+        result.speed = std::max(result.speed, work / taken.count() / 1e6);
+    }
+    return result;
+}
+
+// every member of every object, to be looked up again by key
+void collect_members(const Node& node, std::vector<std::pair<const Node::object*, std::string>>& members) {
+    if (node.get_type() == sjson::ARRAY) {
+        for (const Node& element : node.as_array_reference()) collect_members(element, members);
+    }
+    else if (node.get_type() == sjson::OBJECT) {
+        for (const auto& member : node.as_object_reference()) {
+            members.emplace_back(&node.as_object_reference(), std::string(member.first.view()));
+            collect_members(member.second, members);
+        }
+    }
+}
+
+void bench_corpus(const Corpus& corpus, std::vector<BenchResult>& results) {
+    const double bytes = static_cast<double>(corpus.bytes());
+    const auto nothing = []() {};
+
+    std::vector<Node> trees;
+    trees.reserve(corpus.documents.size());
+    results.push_back(bench_measure(corpus.name, "parse_from_string", bytes, "MB/s", [&]() { trees.clear(); }, [&]() {
+        for (const std::string& document : corpus.documents) trees.push_back(sjson::json::parse_from_string(document));
+    }));
+
+    std::vector<std::istringstream> streams;
+    std::vector<Node> streamed;
+    streamed.reserve(corpus.documents.size());
+    results.push_back(bench_measure(corpus.name, "parse_from_istream", bytes, "MB/s", [&]() {
+        streamed.clear();
+        streams.clear();
+        for (const std::string& document : corpus.documents) streams.emplace_back(document);
+    }, [&]() {
+        for (std::istringstream& stream : streams) streamed.push_back(sjson::json::parse_from_istream(stream));
+    }));
+    streamed.clear();
+    streams.clear();
+
+    results.push_back(bench_measure(corpus.name, "node_to_json_string", bytes, "MB/s", nothing, [&]() {
+        std::size_t written = 0;
+        for (const Node& tree : trees) written += sjson::json::node_to_json_string(tree, sjson::json::JsonFormat::compact()).size();
+        bench_sink = written;
+    }));
+
+    std::vector<Node> copies;
+    copies.reserve(trees.size());
+    results.push_back(bench_measure(corpus.name, "copy", bytes, "MB/s", [&]() { copies.clear(); }, [&]() {
+        for (const Node& tree : trees) copies.push_back(tree);
+    }));
+    results.push_back(bench_measure(corpus.name, "destroy", bytes, "MB/s", [&]() { copies = trees; }, [&]() {
+        copies.clear();
+    }));
+
+    std::vector<std::pair<const Node::object*, std::string>> members;
+    for (const Node& tree : trees) collect_members(tree, members);
+    if (!members.empty()) {
+        results.push_back(bench_measure(corpus.name, "key_lookup", static_cast<double>(members.size()), "Mops/s", nothing, [&]() {
+            std::size_t found = 0;
+            for (const auto& member : members) found += member.first->count(member.second);
+            bench_sink = found;
+        }));
+    }
+}
+
+// machine readable results, for comparing releases
+void write_bench_results(const std::vector<BenchResult>& results, const std::string& path) {
+    std::ofstream file(path, std::ios::binary);
+    sjson::json::StreamSink sink(file);
+    sjson::json::JsonWriter writer(sjson::json::JsonFormat::indented(' ', 2), &sink);
+    writer.start_object();
+    writer.key("compiler");
+    writer.string(__VERSION__);
+    writer.key("results");
+    writer.start_array();
+    for (const BenchResult& result : results) {
+        writer.start_object();
+        writer.key("corpus");
+        writer.string(result.corpus);
+        writer.key("operation");
+        writer.string(result.operation);
+        writer.key("speed");
+        writer.real(result.speed);
+        writer.key("unit");
+        writer.string(result.unit);
+        writer.key("allocations");
+        writer.integer(static_cast<Node::integer>(result.allocations));
+        writer.end_object();
+    }
+    writer.end_array();
+    writer.end_object();
+    writer.flush();
+}
+
+void bench_suite(const std::string& results_path) {
+    const std::vector<Corpus> corpora = {
+        make_numbers_corpus(),
+        make_nested_corpus(),
+        make_logs_corpus(),
+        make_small_documents_corpus(),
+        make_twitter_corpus(),
+    };
+
+    std::vector<BenchResult> results;
+    for (const Corpus& corpus : corpora) {
+        bench_corpus(corpus, results);
+    }
+
+    std::printf("%-16s %-20s %10s %-6s %12s\n", "corpus", "operation", "speed", "", "allocations");
+    for (const BenchResult& result : results) {
+        std::printf("%-16s %-20s %10.1f %-6s %12zu\n", result.corpus.c_str(), result.operation.c_str(), result.speed, result.unit, result.allocations);
+    }
+    if (!results_path.empty()) {
+        write_bench_results(results, results_path);
+        std::printf("results written to %s\n", results_path.c_str());
+    }
+    std::printf("\n");
+}
+
+//= COMPARISONS ========================================
+// how reals were written before JsonWriter, one ostream << per fragment
+void legacy_write(const Node& node, std::ostream& stream) {
+    if (node.get_type() != sjson::ARRAY) {
+        stream << node.as_real();
+        return;
+    }
+    stream << "[\n";
+    for (const Node& element : node.as_array_reference()) {
+        stream << '\t';
+        legacy_write(element, stream);
+        stream << ",\n";
+    }
+    stream << ']';
+}
+
+// reals written by one writer that don't read back as the same value
+std::size_t count_lost(const Node& original, const std::string& written) {
+    const Node reread = sjson::json::parse_from_string(written);
+    const Node::array& before = original.as_array_reference();
+    const Node::array& after = reread.as_array_reference();
+    std::size_t lost = 0;
+    for (std::size_t i = 0; i < before.size(); i++) {
+        lost += (before[i].as_real() != after[i].as_real())? 1 : 0;
+    }
+    return lost;
+}
+
+void bench_real_formatting() {
+    std::mt19937_64 random(42);
+    std::uniform_real_distribution<double> mantissa(-1, 1);
+    std::uniform_int_distribution<int> exponent(-8, 8);
+    Node::array numbers;
+    for (int i = 0; i < 200000; i++) {
+        numbers.push_back(Node(mantissa(random) * std::pow(10.0, exponent(random))));
+    }
+    const Node document(std::move(numbers));
+
+    std::string legacy_output;
+    std::string writer_output;
+    const std::size_t bytes = sjson::json::node_to_json_string(document, sjson::json::JsonFormat::compact()).size();
+
+    const double legacy = bench_mb_per_s(bytes, [&]() {
+        std::ostringstream stream;
+        legacy_write(document, stream);
+        legacy_output = stream.str();
+    });
+    const double writer = bench_mb_per_s(bytes, [&]() {
+        writer_output = sjson::json::node_to_json_string(document, sjson::json::JsonFormat::compact());
+    });
+
+    std::printf("reals, ostream <<      %8.1f MB/s, %zu of %zu values lost\n", legacy, count_lost(document, legacy_output), document.as_array_reference().size());
+    std::printf("reals, JsonWriter      %8.1f MB/s, %zu of %zu values lost (%.1fx)\n", writer, count_lost(document, writer_output), document.as_array_reference().size(), writer / legacy);
+}
+
+void bench_string_escaping() {
+    // long clean ascii strings with the odd escape, like most of our payloads
+    Node::array strings;
+    for (int i = 0; i < 20000; i++) {
+        std::string text(1000, 'a' + i % 26);
+        if (i % 10 == 0) text[500] = '\n';
+        strings.push_back(Node(std::move(text)));
+    }
+    const Node document(std::move(strings));
+    const std::string written = sjson::json::node_to_json_string(document, sjson::json::JsonFormat::compact());
+
+    const char* names[] = {"scalar", "sse2", "avx2"};
+    for (int level = sjson::json::SIMD_NONE; level <= sjson::json::detect_simd_level(); level++) {
+        const double speed = bench_mb_per_s(written.size(), [&]() {
+            std::size_t escapes = 0;
+            for (std::size_t at = 0; at < written.size(); escapes++) {
+                at += sjson::json::find_escape(written.data() + at, written.size() - at, sjson::json::SimdLevel(level)) + 1;
+            }
+            bench_sink = escapes;
+        });
+        std::printf("find_escape, %-8s %8.1f MB/s\n", names[level], speed);
+    }
+
+    const double writer = bench_mb_per_s(written.size(), [&]() {
+        bench_sink = sjson::json::node_to_json_string(document, sjson::json::JsonFormat::compact()).size();
+    });
+    const double reader = bench_mb_per_s(written.size(), [&]() {
+        bench_sink = sjson::json::parse_from_string(written).as_array_reference().size();
+    });
+    std::printf("strings, JsonWriter    %8.1f MB/s\n", writer);
+    std::printf("strings, parse         %8.1f MB/s\n", reader);
+}
+
+void bench_utf8_validation() {
+    const std::string text = make_records_text(100000, [](int i) -> std::string {
+        return (i % 8 == 0)? ", \"city\": \"Z\xc3\xbcrich \xe2\x82\xac\"" : ", \"city\": \"Zurich\"";
+    });
+
+    sjson::json::ParseOptions validate;
+    validate.validate_utf8 = true;
+    const double plain = bench_mb_per_s(text.size(), [&]() {
+        bench_sink = sjson::json::parse_from_string(text).as_array_reference().size();
+    });
+    const double validated = bench_mb_per_s(text.size(), [&]() {
+        bench_sink = sjson::json::parse_from_string(text, validate).as_array_reference().size();
+    });
+    std::printf("parse                  %8.1f MB/s\n", plain);
+    std::printf("parse, validate utf-8  %8.1f MB/s (%.1f%% slower)\n", validated, (plain / validated - 1) * 100);
+}
+
+void bench_messagepack_reader() {
+    const std::string text = make_records_text(100000, [](int i) { return ", \"active\": null" + scores_member(i); });
+    const Node document = sjson::json::parse_from_string(text);
+    const std::string packed = sjson::messagepack::write(document);
+
+    // both over the same values, so MB/s is of the json text for each
+    const double json = bench_mb_per_s(text.size(), [&]() {
+        bench_sink = sjson::json::parse_from_string(text).as_array_reference().size();
+    });
+    const double messagepack = bench_mb_per_s(text.size(), [&]() {
+        bench_sink = sjson::messagepack::parse_from_string(packed).as_array_reference().size();
+    });
+    std::printf("decode, json           %8.1f MB/s of json\n", json);
+    std::printf("decode, messagepack    %8.1f MB/s of json (%.1fx, %zu vs %zu bytes)\n", messagepack, messagepack / json, packed.size(), text.size());
+}
+
+void bench_messagepack_writer() {
+    const std::string text = make_records_text(100000, [](int i) { return ", \"active\": null" + scores_member(i); });
+    const Node document = sjson::json::parse_from_string(text);
+
+    const double json = bench_mb_per_s(text.size(), [&]() {
+        bench_sink = sjson::json::node_to_json_string(document, sjson::json::JsonFormat::compact()).size();
+    });
+    const double growing = bench_mb_per_s(text.size(), [&]() {
+        bench_sink = sjson::messagepack::write(document).size();
+    });
+    const double exact = bench_mb_per_s(text.size(), [&]() {
+        bench_sink = sjson::messagepack::write(document, true).size();
+    });
+    std::printf("encode, json           %8.1f MB/s of json\n", json);
+    std::printf("encode, messagepack    %8.1f MB/s of json (%.1fx, %zu vs %zu bytes)\n", growing, growing / json,
+        sjson::messagepack::write(document).size(), sjson::json::node_to_json_string(document, sjson::json::JsonFormat::compact()).size());
+    std::printf("encode, exact size     %8.1f MB/s of json\n", exact);
+}
+
+void bench_parse_parallel() {
+    const std::string text = make_records_text(200000, scores_member);
+
+    const unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int threads = 1; threads <= cores; threads *= 2) {
+        sjson::json::ParallelOptions options;
+        options.threads = threads;
+        const double speed = bench_mb_per_s(text.size(), [&]() {
+            bench_sink = sjson::json::parse_parallel(text, options).as_array_reference().size();
+        });
+        std::printf("parse_parallel, %2u thr%8.1f MB/s\n", threads, speed);
+    }
+}
+
+void bench_parse_lines() {
+    const std::string text = make_records_text(200000, [](int i) { return ", \"score\": " + std::to_string(i / 7.0); }, true);
+
+    const unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int threads = 1; threads <= cores; threads *= 2) {
+        sjson::json::LinesOptions options;
+        options.threads = threads;
+        const double speed = bench_mb_per_s(text.size(), [&]() {
+            std::size_t records = 0;
+            sjson::json::parse_lines(text, [&](std::size_t, Node&&) { records++; }, [](std::size_t, std::exception_ptr) {}, options);
+            bench_sink = records;
+        });
+        std::printf("parse_lines, %2u thr   %8.1f MB/s\n", threads, speed);
+    }
+}
+
+void bench_transcoding() {
+    const std::string text = make_records_text(100000, [](int i) { return ", \"active\": true" + scores_member(i); });
+    const std::string bytes = sjson::messagepack::from_json(text);
+
+    const double tree_in = bench_mb_per_s(text.size(), [&]() {
+        bench_sink = sjson::messagepack::write(sjson::json::parse_from_string(text)).size();
+    });
+    const double direct_in = bench_mb_per_s(text.size(), [&]() {
+        bench_sink = sjson::messagepack::from_json(text).size();
+    });
+    const double tree_out = bench_mb_per_s(text.size(), [&]() {
+        bench_sink = sjson::json::node_to_json_string(sjson::messagepack::parse_from_string(bytes), sjson::json::JsonFormat::compact()).size();
+    });
+    const double direct_out = bench_mb_per_s(text.size(), [&]() {
+        bench_sink = sjson::messagepack::to_json(bytes).size();
+    });
+    std::printf("json to mp, via tree   %8.1f MB/s of json\n", tree_in);
+    std::printf("json to mp, direct     %8.1f MB/s of json (%.1fx)\n", direct_in, direct_in / tree_in);
+    std::printf("mp to json, via tree   %8.1f MB/s of json\n", tree_out);
+    std::printf("mp to json, direct     %8.1f MB/s of json (%.1fx)\n", direct_out, direct_out / tree_out);
+}
+
+void bench_file_loading() {
+    const std::string text = make_records_text(100000, [](int i) {
+        return ", \"message\": \"request " + std::to_string(i) + " served from the cache in a few milliseconds\"";
+    });
+    const std::string path = "sjson_bench_file.json";
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << text;
+    }
+
+    const double stream = bench_mb_per_s(text.size(), [&]() {
+        std::ifstream file(path, std::ios::binary);
+        bench_sink = sjson::json::parse_from_istream(file).as_array_reference().size();
+    });
+    const double mapped = bench_mb_per_s(text.size(), [&]() {
+        bench_sink = sjson::json::from_file_path(path).as_array_reference().size();
+    });
+    sjson::Document document;
+    const double borrowed = bench_mb_per_s(text.size(), [&]() {
+        bench_sink = document.load_file(path).as_array_reference().size();
+    });
+    std::printf("file, istream          %8.1f MB/s\n", stream);
+    std::printf("file, mapped           %8.1f MB/s\n", mapped);
+    std::printf("file, Document borrow  %8.1f MB/s\n", borrowed);
+    std::remove(path.c_str());
+}
+
+void bench_pointers() {
+    std::string text = "[";
+    for (int i = 0; i < 20000; i++) {
+        text += "{\"id\": " + std::to_string(i) + ", \"user\": {\"name\": \"u" + std::to_string(i)
+            + "\", \"screen_name\": \"s\", \"followers\": 10, \"lang\": \"en\", \"location\": \"x\", \"verified\": false, \"url\": null, \"created_at\": \"t\"}, \"retweets\": 0}, ";
+    }
+    text += "null]";
+    const Node document = sjson::json::parse_from_string(text);
+    const Node::array& records = document.as_array_reference();
+    const std::size_t lookups = (records.size() - 1) * 3;
+
+    // the three fields a consumer reads from every record
+    const double chained = bench_mb_per_s(lookups, [&]() {
+        std::size_t found = 0;
+        for (std::size_t i = 0; i + 1 < records.size(); i++) {
+            const Node::object& user = records[i].as_object_reference().at("user").as_object_reference();
+            found += user.at("name").as_string_view().size() + user.at("lang").as_string_view().size() + user.at("created_at").as_string_view().size();
+        }
+        bench_sink = found;
+    });
+    const sjson::json::Pointer name("/user/name");
+    const sjson::json::Pointer lang("/user/lang");
+    const sjson::json::Pointer created("/user/created_at");
+    const double pointers = bench_mb_per_s(lookups, [&]() {
+        std::size_t found = 0;
+        for (std::size_t i = 0; i + 1 < records.size(); i++) {
+            found += name.find(records[i])->as_string_view().size() + lang.find(records[i])->as_string_view().size() + created.find(records[i])->as_string_view().size();
+        }
+        bench_sink = found;
+    });
+    sjson::json::PointerSet set;
+    set.add(name);
+    set.add(lang);
+    set.add(created);
+    std::vector<const Node*> results;
+    const double batched = bench_mb_per_s(lookups, [&]() {
+        std::size_t found = 0;
+        for (std::size_t i = 0; i + 1 < records.size(); i++) {
+            set.find(records[i], results);
+            for (const Node* result : results) found += result->as_string_view().size();
+        }
+        bench_sink = found;
+    });
+    std::printf("lookups, chained at()  %8.1f M/s\n", chained);
+    std::printf("lookups, Pointer       %8.1f M/s\n", pointers);
+    std::printf("lookups, PointerSet    %8.1f M/s\n", batched);
+}
+
+// sjson_bench [results.json]
+int main(int argc, char** argv) {
+    bench_suite((argc > 1)? argv[1] : "");
+    bench_real_formatting();
+    bench_string_escaping();
+    bench_utf8_validation();
+    bench_parse_lines();
+    bench_parse_parallel();
+    bench_messagepack_reader();
+    bench_messagepack_writer();
+    bench_transcoding();
+    bench_file_loading();
+    bench_pointers();
+    return 0;
+}
+
+#endif